@@ -0,0 +1,187 @@
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include "geometry.h"
+
+using namespace std;
+
+// guides and colour for every camera ray, laid out on the ray grid rather than the screen so a frame rendered at camera
+// resolution r is filtered at 1/r² of the pixel count. every channel is its own float plane so the filter below walks
+// plain contiguous rows, which the compiler turns into SIMD loops under -Ofast -march=native
+struct Denoise_Buffers{
+    int width = 0;
+    int height = 0;
+    vector<float> normal_x, normal_y, normal_z;
+    vector<float> depth;
+    vector<float> object;
+    vector<float> albedo_r, albedo_g, albedo_b;
+    vector<float> r, g, b;
+    vector<float> next_r, next_g, next_b;
+    vector<Uint32> colors;
+
+    void resize(int width_, int height_){
+        width = width_;
+        height = height_;
+
+        for (vector<float>* plane : {&normal_x, &normal_y, &r, &g, &b, &next_r, &next_g, &next_b}){
+            plane->assign(width * height, 0);
+        }
+
+        // cells keep looking like misses until a ray has been traced for them
+        normal_z.assign(width * height, -1);
+        depth.assign(width * height, 1e30);
+        object.assign(width * height, -1);
+        albedo_r.assign(width * height, 1);
+        albedo_g.assign(width * height, 1);
+        albedo_b.assign(width * height, 1);
+        colors.assign(width * height, 0);
+    }
+
+    // misses get object -1 and a normal facing the camera so they only ever blend with other misses
+    void set(int index, vector3 normal, double distance, int object_index, Color albedo){
+        normal_x[index] = normal.x;
+        normal_y[index] = normal.y;
+        normal_z[index] = normal.z;
+        depth[index] = distance;
+        object[index] = object_index;
+        albedo_r[index] = max(albedo.r / 255.0f, 0.01f);
+        albedo_g[index] = max(albedo.g / 255.0f, 0.01f);
+        albedo_b[index] = max(albedo.b / 255.0f, 0.01f);
+    }
+
+    // the traced colour, with the albedo set above divided out so texture detail doesn't get smeared
+    void set_color(int index, Uint32 color){
+        colors[index] = color;
+        r[index] = ((color >> 24) & 255) / 255.0f / albedo_r[index];
+        g[index] = ((color >> 16) & 255) / 255.0f / albedo_g[index];
+        b[index] = ((color >> 8) & 255) / 255.0f / albedo_b[index];
+    }
+};
+
+// one edge-avoiding a-trous pass over rows [y_start, y_end), taps are step cells apart. colour is filtered with the
+// albedo divided out, it's multiplied back in after the last pass
+void atrous_rows(Denoise_Buffers& buffers, int step, float color_sigma, int y_start, int y_end){
+    const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+    const int width = buffers.width;
+    const int height = buffers.height;
+    const float inverse_color_sigma = 1.0f / (color_sigma * color_sigma);
+    const float inverse_depth_sigma = 1.0f / (0.01f * step);
+
+    vector<float> sums(width * 4);
+    float* sum_r = sums.data();
+    float* sum_g = sum_r + width;
+    float* sum_b = sum_g + width;
+    float* sum_weight = sum_b + width;
+
+    const float* r = buffers.r.data();
+    const float* g = buffers.g.data();
+    const float* b = buffers.b.data();
+    const float* normal_x = buffers.normal_x.data();
+    const float* normal_y = buffers.normal_y.data();
+    const float* normal_z = buffers.normal_z.data();
+    const float* depth = buffers.depth.data();
+    const float* object = buffers.object.data();
+
+    for (int y = y_start; y < y_end; ++y){
+        fill(sums.begin(), sums.end(), 0);
+
+        for (int j = -2; j <= 2; ++j){
+            int tap_y = y + j * step;
+
+            if (tap_y < 0 || tap_y >= height) continue;
+
+            for (int i = -2; i <= 2; ++i){
+                int offset = i * step;
+                int x_start = max(0, -offset);
+                int x_end = min(width, width - offset);
+                float k = kernel[j + 2] * kernel[i + 2];
+                int p = y * width;
+                int q = tap_y * width + offset;
+
+                // taps off the edge of the image are skipped by narrowing the range rather than branching per pixel.
+                // the sums never overlap the planes being read, ivdep saves gcc from giving up on too many alias checks
+                #pragma GCC ivdep
+                for (int x = x_start; x < x_end; ++x){
+                    float dr = r[q + x] - r[p + x];
+                    float dg = g[q + x] - g[p + x];
+                    float db = b[q + x] - b[p + x];
+                    float color_distance = (dr * dr + dg * dg + db * db) * inverse_color_sigma;
+
+                    float depth_distance = fabsf(depth[q + x] - depth[p + x]) * inverse_depth_sigma / (depth[p + x] + 1e-6f);
+
+                    float normal_weight = fmaxf(0.0f, normal_x[p + x] * normal_x[q + x] + normal_y[p + x] * normal_y[q + x] + normal_z[p + x] * normal_z[q + x]);
+                    normal_weight *= normal_weight;
+                    normal_weight *= normal_weight;
+                    normal_weight *= normal_weight;
+                    normal_weight *= normal_weight;
+                    normal_weight *= normal_weight;
+
+                    float same_object = object[q + x] == object[p + x] ? 1.0f : 0.0f;
+                    float weight = k * expf(-color_distance - depth_distance) * normal_weight * same_object;
+
+                    sum_r[x] += weight * r[q + x];
+                    sum_g[x] += weight * g[q + x];
+                    sum_b[x] += weight * b[q + x];
+                    sum_weight[x] += weight;
+                }
+            }
+        }
+
+        float* next_r = buffers.next_r.data() + y * width;
+        float* next_g = buffers.next_g.data() + y * width;
+        float* next_b = buffers.next_b.data() + y * width;
+
+        #pragma GCC ivdep
+        for (int x = 0; x < width; ++x){
+            float inverse_weight = sum_weight[x] > 0 ? 1 / sum_weight[x] : 0;
+            next_r[x] = sum_weight[x] > 0 ? sum_r[x] * inverse_weight : r[y * width + x];
+            next_g[x] = sum_weight[x] > 0 ? sum_g[x] * inverse_weight : g[y * width + x];
+            next_b[x] = sum_weight[x] > 0 ? sum_b[x] * inverse_weight : b[y * width + x];
+        }
+    }
+}
+
+void pack_rows(Denoise_Buffers& buffers, int y_start, int y_end){
+    for (int i = y_start * buffers.width; i < y_end * buffers.width; ++i){
+        Uint32 r = min(255.0f, buffers.r[i] * buffers.albedo_r[i] * 255);
+        Uint32 g = min(255.0f, buffers.g[i] * buffers.albedo_g[i] * 255);
+        Uint32 b = min(255.0f, buffers.b[i] * buffers.albedo_b[i] * 255);
+        buffers.colors[i] = (r << 24) | (g << 16) | (b << 8) | (buffers.colors[i] & 255);
+    }
+}
+
+// filters the colours set on buffers and leaves the result in buffers.colors, one per camera ray
+void denoise(Denoise_Buffers& buffers, int iterations, int thread_count){
+    int rows = max(1, (buffers.height + thread_count - 1) / max(1, thread_count));
+
+    for (int iteration = 0; iteration < iterations; ++iteration){
+        // each pass doubles the tap spacing and tightens the colour threshold so later passes only smooth what's left
+        int step = 1 << iteration;
+        float color_sigma = 0.6f / (1 << iteration);
+
+        vector<thread> threads;
+
+        for (int y = 0; y < buffers.height; y += rows){
+            threads.push_back(thread(atrous_rows, ref(buffers), step, color_sigma, y, min(buffers.height, y + rows)));
+        }
+
+        for (thread& thread : threads) {
+            thread.join();
+        }
+
+        swap(buffers.r, buffers.next_r);
+        swap(buffers.g, buffers.next_g);
+        swap(buffers.b, buffers.next_b);
+    }
+
+    vector<thread> threads;
+
+    for (int y = 0; y < buffers.height; y += rows){
+        threads.push_back(thread(pack_rows, ref(buffers), y, min(buffers.height, y + rows)));
+    }
+
+    for (thread& thread : threads) {
+        thread.join();
+    }
+}
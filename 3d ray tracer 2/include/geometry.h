@@ -54,6 +54,10 @@ struct vector3 {
         return vector3(x * other.x, y * other.y, z * other.z);
     }
 
+    vector3 operator/(vector3 other) const {
+        return vector3(x / other.x, y / other.y, z / other.z);
+    }
+
     vector3 operator*(double other) const {
         return vector3(x * other, y * other, z * other);
     }
@@ -13,6 +13,14 @@ double dot_product(vector3 a, vector3 b){
     return a.x*b.x + a.y*b.y + a.z*b.z;
 }
 
+vector3 min_vector3(vector3 a, vector3 b){
+    return vector3(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z);
+}
+
+vector3 max_vector3(vector3 a, vector3 b){
+    return vector3(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z);
+}
+
 vector3 matrix_multiply(vector3 vector, Matrix matrix){
     vector3 new_vector(0, 0, 0);
 
@@ -0,0 +1,129 @@
+#include <vector>
+#include <map>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include "geometry.h"
+
+using namespace std;
+
+struct Texture_Level{
+    int width;
+    int height;
+    vector<Color> texels;
+
+    Color texel(int x, int y) const {
+        x = ((x % width) + width) % width;
+        y = ((y % height) + height) % height;
+        return texels[y * width + x];
+    }
+};
+
+// levels[0] is the full image, each level after it is half the size of the one before down to 1x1
+struct Texture{
+    vector<Texture_Level> levels;
+};
+
+vector<Texture> textures;
+map<string, int> texture_ids;
+
+Texture_Level downsample(const Texture_Level& level){
+    Texture_Level next;
+    next.width = level.width > 1 ? level.width / 2 : 1;
+    next.height = level.height > 1 ? level.height / 2 : 1;
+
+    for (int y = 0; y < next.height; ++y){
+        for (int x = 0; x < next.width; ++x){
+            int x2 = min(x * 2 + 1, level.width - 1);
+            int y2 = min(y * 2 + 1, level.height - 1);
+            Color a = level.texel(x * 2, y * 2), b = level.texel(x2, y * 2), c = level.texel(x * 2, y2), d = level.texel(x2, y2);
+
+            next.texels.push_back(Color((a.r + b.r + c.r + d.r) / 4, (a.g + b.g + c.g + d.g) / 4, (a.b + b.b + c.b + d.b) / 4));
+        }
+    }
+
+    return next;
+}
+
+// binary ppm (P6) with a max value of 255, the same thing write_ppm produces
+bool read_texture_file(string file_name, Texture& texture){
+    ifstream texture_file(file_name, ios::binary);
+    string magic;
+    int width, height, max_value;
+
+    if (!(texture_file >> magic >> width >> height >> max_value) || magic != "P6" || max_value != 255 || width <= 0 || height <= 0){
+        return false;
+    }
+
+    texture_file.get();
+
+    Texture_Level level;
+    level.width = width;
+    level.height = height;
+
+    vector<unsigned char> rgb(width * height * 3);
+
+    if (!texture_file.read((char*)rgb.data(), rgb.size())) return false;
+
+    for (int i = 0; i < width * height; ++i){
+        level.texels.push_back(Color(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]));
+    }
+
+    texture.levels.push_back(level);
+
+    while (texture.levels.back().width > 1 || texture.levels.back().height > 1){
+        texture.levels.push_back(downsample(texture.levels.back()));
+    }
+
+    return true;
+}
+
+// textures are cached by file name so every material using the same image shares one copy, returns -1 on failure
+int load_texture(string file_name){
+    auto id = texture_ids.find(file_name);
+
+    if (id != texture_ids.end()) return id->second;
+
+    Texture texture;
+
+    if (!read_texture_file(file_name, texture)){
+        cerr << "could not read texture " << file_name << endl;
+        return -1;
+    }
+
+    textures.push_back(texture);
+    texture_ids[file_name] = textures.size() - 1;
+
+    return textures.size() - 1;
+}
+
+Color sample_level(const Texture_Level& level, vector2 uv){
+    // obj puts the uv origin in the bottom left, images start at the top left
+    double x = uv.x * level.width - 0.5;
+    double y = (1 - uv.y) * level.height - 0.5;
+    int x0 = floor(x);
+    int y0 = floor(y);
+    double fx = x - x0;
+    double fy = y - y0;
+
+    Color a = level.texel(x0, y0), b = level.texel(x0 + 1, y0), c = level.texel(x0, y0 + 1), d = level.texel(x0 + 1, y0 + 1);
+
+    return Color(
+        (a.r * (1 - fx) + b.r * fx) * (1 - fy) + (c.r * (1 - fx) + d.r * fx) * fy,
+        (a.g * (1 - fx) + b.g * fx) * (1 - fy) + (c.g * (1 - fx) + d.g * fx) * fy,
+        (a.b * (1 - fx) + b.b * fx) * (1 - fy) + (c.b * (1 - fx) + d.b * fx) * fy);
+}
+
+// trilinear, lod is log2 of how many level 0 texels one pixel covers
+Color sample_texture(const Texture& texture, vector2 uv, double lod){
+    int last = texture.levels.size() - 1;
+
+    if (!(lod > 0)) return sample_level(texture.levels[0], uv);
+    if (lod >= last) return sample_level(texture.levels[last], uv);
+
+    int level = floor(lod);
+    double blend = lod - level;
+
+    return sample_level(texture.levels[level], uv) * (1 - blend) + sample_level(texture.levels[level + 1], uv) * blend;
+}
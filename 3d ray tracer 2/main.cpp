@@ -7,6 +7,8 @@
 #include "include/geometry.h"
 #include "include/math.cpp"
 #include "include/sdl_draw.cpp"
+#include "include/texture.cpp"
+#include "include/denoise.cpp"
 #include <random>
 #include <math.h>
 #include <chrono>
@@ -15,6 +17,15 @@
 #include <sstream>
 #include <algorithm>
 #include <thread>
+#include <map>
+#include <functional>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "include/general.cpp"
 
 using namespace std;
@@ -40,59 +51,403 @@ struct Material{
     double refractive_albedo;
     double reflective_albedo;
     double specular_exponent;
+    int texture;
 
-    Material(Color color, Material_Flags flag, double refractive_index=0, double diffuse_albedo=0, double specular_albedo=0, double reflective_albedo=0, double refractive_albedo=0, double specular_exponent=0) : color(color), flag(flag), refractive_index(refractive_index), diffuse_albedo(diffuse_albedo), specular_albedo(specular_albedo), reflective_albedo(reflective_albedo), refractive_albedo(refractive_albedo), specular_exponent(specular_exponent) {}
+    Material(Color color, Material_Flags flag, double refractive_index=0, double diffuse_albedo=0, double specular_albedo=0, double reflective_albedo=0, double refractive_albedo=0, double specular_exponent=0, int texture=-1) : color(color), flag(flag), refractive_index(refractive_index), diffuse_albedo(diffuse_albedo), specular_albedo(specular_albedo), reflective_albedo(reflective_albedo), refractive_albedo(refractive_albedo), specular_exponent(specular_exponent), texture(texture) {}
 };
 
+// object space triangle as read from the .obj, its vertex normals and uvs are kept apart in the mesh's streams
 struct Triangle{
     vector3 vertex_1;
     vector3 vertex_2;
     vector3 vertex_3;
+
+    Triangle(vector3 vertex_1=vector3(), vector3 vertex_2=vector3(), vector3 vertex_3=vector3()) : vertex_1(vertex_1), vertex_2(vertex_2), vertex_3(vertex_3) {};
+};
+
+// a world space triangle in the form the intersector wants, the edges from vertex_1 are worked out once in
+// Object::update() instead of for every ray
+struct Triangle_Record{
+    vector3 vertex_1;
+    vector3 edge_1;
+    vector3 edge_2;
     vector3 normal;
 
-    Triangle(vector3 vertex_1, vector3 vertex_2, vector3 vertex_3) : vertex_1(vertex_1), vertex_2(vertex_2), vertex_3(vertex_3) {};
+    vector3 vertex_2() const {
+        return vertex_1 + edge_1;
+    }
+
+    vector3 vertex_3() const {
+        return vertex_1 + edge_2;
+    }
+
+    vector3 centroid() const {
+        return vertex_1 + (edge_1 + edge_2) / 3;
+    }
+};
+
+// interior nodes have count 0 and their children at first and first + 1, leaves hold triangles [first, first + count)
+struct BVH_Node{
+    vector3 bounds_min;
+    vector3 bounds_max;
+    int first;
+    int count;
+};
+
+// a read-only view of an object's triangles and hierarchy, either into the object's own vectors or into a mapped snapshot.
+// sources gives the mesh triangle each record was made from, building the hierarchy reorders the records but the mesh's
+// vertex attributes stay where they are
+struct BVH{
+    const Triangle_Record* triangles = nullptr;
+    const BVH_Node* nodes = nullptr;
+    int triangle_count = 0;
+    int node_count = 0;
+    const int* sources = nullptr;
+};
+
+// a read-only view of a mesh's vertex normals and uvs, either into the mesh cache or into a mapped snapshot. each
+// attribute is stored once per vertex as the .obj lists it, one stream per component, and the three corners of every
+// mesh triangle index into them (-1 for a corner the face gave none). a stream is null when no face in the mesh used it.
+// they're kept apart from the triangle records so traversal never pulls them into the cache, they're only read for the
+// hit that ends up being shaded, and every object made from the mesh shares them
+struct Mesh_Streams{
+    int triangle_count = 0;
+    int normal_count = 0;
+    int uv_count = 0;
+    const int* normal_indices = nullptr;
+    const int* uv_indices = nullptr;
+    const double* normal_x = nullptr;
+    const double* normal_y = nullptr;
+    const double* normal_z = nullptr;
+    const double* uv_u = nullptr;
+    const double* uv_v = nullptr;
+
+    vector3 normal(int index) const {
+        return index >= 0 ? vector3(normal_x[index], normal_y[index], normal_z[index]) : vector3();
+    }
+
+    vector2 uv(int index) const {
+        return index >= 0 ? vector2(uv_u[index], uv_v[index]) : vector2();
+    }
+};
+
+// a parsed .obj as kept in the mesh cache, objects copy the triangles and point at the streams
+struct Mesh{
+    vector<Triangle> triangles;
+    vector<int> normal_indices;
+    vector<int> uv_indices;
+    vector<double> normal_x, normal_y, normal_z;
+    vector<double> uv_u, uv_v;
+
+    Mesh_Streams streams() const {
+        Mesh_Streams streams;
+        streams.triangle_count = triangles.size();
+
+        if (!normal_indices.empty()){
+            streams.normal_count = normal_x.size();
+            streams.normal_indices = normal_indices.data();
+            streams.normal_x = normal_x.data();
+            streams.normal_y = normal_y.data();
+            streams.normal_z = normal_z.data();
+        }
+
+        if (!uv_indices.empty()){
+            streams.uv_count = uv_u.size();
+            streams.uv_indices = uv_indices.data();
+            streams.uv_u = uv_u.data();
+            streams.uv_v = uv_v.data();
+        }
+
+        return streams;
+    }
 };
 
+const int bvh_leaf_size = 4;
+const int bvh_stack_size = 64;
+const int motion_box_depth = 3;
+
 vector3 rotate(vector3, vector3);
+vector3 rotate_x(double, vector3);
+vector3 rotate_y(double, vector3);
+vector3 rotate_z(double, vector3);
+
+// where a rotation takes each axis. rotating is linear, so something rotated many times by the same angles is cheaper
+// as a mix of these than through rotate, which builds its matrices on every call
+struct Basis{
+    vector3 x = vector3(1, 0, 0);
+    vector3 y = vector3(0, 1, 0);
+    vector3 z = vector3(0, 0, 1);
+
+    vector3 apply(vector3 vector) const {
+        return x * vector.x + y * vector.y + z * vector.z;
+    }
+};
+
+Basis rotation_basis(vector3 angle){
+    return Basis{rotate(vector3(1, 0, 0), angle), rotate(vector3(0, 1, 0), angle), rotate(vector3(0, 0, 1), angle)};
+}
 
 struct Object{
     vector3 position;
     vector3 rotation;
-    vector<Triangle> triangles;
+    vector<Triangle_Record> triangles;
     vector<Triangle> original_triangles;
     Material material;
     vector3 scale;
-
-    Object(vector3 position_, vector3 rotation_, vector3 scale, Material material, vector<Triangle> triangles) : scale(scale), material(material), original_triangles(triangles), triangles(triangles) {
-        position = position_;
-        rotation = rotation_;
+    vector3 spin;
+    vector<BVH_Node> nodes;
+    vector<int> sources;
+    Mesh_Streams streams;
+    Basis basis;
+    BVH mapped;
+
+    Object(vector3 position, vector3 rotation, vector3 scale, Material material, vector<Triangle> triangles, vector3 spin=vector3()) : position(position), rotation(rotation), triangles(triangles.size()), original_triangles(triangles), material(material), scale(scale), spin(spin) {
+        for (int i = 0; i < (int)triangles.size(); ++i) sources.push_back(i);
     }
 
     void update(){
         for (int i = 0; i < triangles.size(); ++i){
-            Triangle& triangle = triangles[i];
+            Triangle_Record& triangle = triangles[i];
             Triangle& original_triangle = original_triangles[i];
-            triangle.vertex_3 = rotate(original_triangle.vertex_3 * scale, rotation) + position;
-            triangle.vertex_2 = rotate(original_triangle.vertex_2 * scale, rotation) + position;
+            vector3 vertex_3 = rotate(original_triangle.vertex_3 * scale, rotation) + position;
+            vector3 vertex_2 = rotate(original_triangle.vertex_2 * scale, rotation) + position;
             triangle.vertex_1 = rotate(original_triangle.vertex_1 * scale, rotation) + position;
-            
-            vector3 direction = cross_multiply(triangle.vertex_2 - triangle.vertex_1, triangle.vertex_3 - triangle.vertex_1);
+            triangle.edge_1 = vertex_2 - triangle.vertex_1;
+            triangle.edge_2 = vertex_3 - triangle.vertex_1;
+
+            vector3 direction = cross_multiply(triangle.edge_1, triangle.edge_2);
             triangle.normal = direction / direction.magnitude();
         }
+
+        // objects only ever move rigidly, so after the first build refitting the bounds keeps the hierarchy good enough
+        if (nodes.empty()){
+            build_bvh();
+        } else {
+            refit_bvh();
+        }
+
+        // the mesh's vertex normals are shared, they're turned into world space through this when a hit is shaded
+        basis = rotation_basis(rotation);
+    }
+
+    // a box triangles [first, first + count) stay inside for every angle of the object's spin. spinning about one axis
+    // sweeps each vertex round a circle, the circles are boxed in the frame the spin happens in and the box corners taken
+    // through the rotations applied after it. anything else gets a box around the sphere they fit in under any rotation
+    BVH_Node swept_box(int first, int count) const {
+        int axis = -1;
+        int spin_axes = (spin.x != 0) + (spin.y != 0) + (spin.z != 0);
+
+        if (spin_axes == 1) axis = spin.x != 0 ? 0 : (spin.y != 0 ? 1 : 2);
+
+        vector3 bounds_min(INFINITY, INFINITY, INFINITY);
+        vector3 bounds_max(-INFINITY, -INFINITY, -INFINITY);
+        double radius = 0;
+
+        for (int i = first; i < first + count; ++i){
+            const Triangle& triangle = original_triangles[i];
+
+            for (vector3 vertex : {triangle.vertex_1, triangle.vertex_2, triangle.vertex_3}){
+                vertex = vertex * scale;
+                radius = max(radius, vertex.magnitude());
+
+                if (axis >= 1) vertex = rotate_x(rotation.x, vertex);
+                if (axis == 2) vertex = rotate_y(rotation.y, vertex);
+
+                double circle = axis == 0 ? sqrt(vertex.y * vertex.y + vertex.z * vertex.z) :
+                    (axis == 1 ? sqrt(vertex.x * vertex.x + vertex.z * vertex.z) : sqrt(vertex.x * vertex.x + vertex.y * vertex.y));
+                vector3 center(axis == 0 ? vertex.x : 0, axis == 1 ? vertex.y : 0, axis == 2 ? vertex.z : 0);
+                vector3 extent(axis == 0 ? 0 : circle, axis == 1 ? 0 : circle, axis == 2 ? 0 : circle);
+
+                bounds_min = min_vector3(bounds_min, center - extent);
+                bounds_max = max_vector3(bounds_max, center + extent);
+            }
+        }
+
+        radius = radius * (1 + 1e-9) + 1e-6;
+
+        if (axis == -1) return BVH_Node{position - vector3(radius, radius, radius), position + vector3(radius, radius, radius), first, count};
+
+        vector3 swept_min(INFINITY, INFINITY, INFINITY);
+        vector3 swept_max(-INFINITY, -INFINITY, -INFINITY);
+
+        for (int corner = 0; corner < 8; ++corner){
+            vector3 point(corner & 1 ? bounds_max.x : bounds_min.x, corner & 2 ? bounds_max.y : bounds_min.y, corner & 4 ? bounds_max.z : bounds_min.z);
+
+            if (axis == 0) point = rotate_y(rotation.y, point);
+            if (axis <= 1) point = rotate_z(rotation.z, point);
+
+            swept_min = min_vector3(swept_min, point);
+            swept_max = max_vector3(swept_max, point);
+        }
+
+        // the padding covers the rounding in rotate, the box must never be smaller than the triangles it stands for
+        vector3 padding = (swept_max - swept_min) * 1e-9 + vector3(1e-6, 1e-6, 1e-6);
+
+        return BVH_Node{swept_min - padding + position, swept_max + padding + position, first, count};
+    }
+
+    // boxes a spinning object stays inside from frame to frame, one per hierarchy node motion_box_depth levels down (or
+    // leaf above that). refitting never moves a triangle between nodes, so while only the spin angle changes they stay
+    // the same, and splitting them up keeps a tall spinning object from claiming every ray that passes near its axis
+    vector<BVH_Node> motion_boxes() const {
+        vector<BVH_Node> boxes;
+        BVH bvh = this->bvh();
+
+        if (bvh.node_count == 0) return boxes;
+
+        vector<pair<int, int>> stack = {{0, 0}};
+
+        while (!stack.empty()){
+            int index = stack.back().first;
+            int depth = stack.back().second;
+            stack.pop_back();
+
+            const BVH_Node& node = bvh.nodes[index];
+
+            if (node.count == 0 && depth < motion_box_depth){
+                stack.push_back({node.first, depth + 1});
+                stack.push_back({node.first + 1, depth + 1});
+                continue;
+            }
+
+            int first = node.first;
+            int last = node.first + node.count;
+
+            // an interior node's triangles are the range spanned by its leftmost and rightmost leaves
+            if (node.count == 0){
+                int left = index, right = index;
+                while (bvh.nodes[left].count == 0) left = bvh.nodes[left].first;
+                while (bvh.nodes[right].count == 0) right = bvh.nodes[right].first + 1;
+                first = bvh.nodes[left].first;
+                last = bvh.nodes[right].first + bvh.nodes[right].count;
+            }
+
+            boxes.push_back(swept_box(first, last - first));
+        }
+
+        return boxes;
+    }
+
+    BVH bvh() const {
+        if (mapped.nodes != nullptr) return mapped;
+
+        return BVH{triangles.data(), nodes.data(), int(triangles.size()), int(nodes.size()), sources.data()};
+    }
+
+    void build_bvh(){
+        nodes.clear();
+
+        if (triangles.empty()) return;
+
+        nodes.push_back(BVH_Node{vector3(), vector3(), 0, int(triangles.size())});
+        subdivide(0);
+    }
+
+    void fit_node(int node_index){
+        BVH_Node& node = nodes[node_index];
+
+        if (node.count == 0){
+            node.bounds_min = min_vector3(nodes[node.first].bounds_min, nodes[node.first + 1].bounds_min);
+            node.bounds_max = max_vector3(nodes[node.first].bounds_max, nodes[node.first + 1].bounds_max);
+            return;
+        }
+
+        node.bounds_min = vector3(INFINITY, INFINITY, INFINITY);
+        node.bounds_max = vector3(-INFINITY, -INFINITY, -INFINITY);
+
+        for (int i = node.first; i < node.first + node.count; ++i){
+            Triangle_Record& triangle = triangles[i];
+            node.bounds_min = min_vector3(node.bounds_min, min_vector3(triangle.vertex_1, min_vector3(triangle.vertex_2(), triangle.vertex_3())));
+            node.bounds_max = max_vector3(node.bounds_max, max_vector3(triangle.vertex_1, max_vector3(triangle.vertex_2(), triangle.vertex_3())));
+        }
+
+        // pad so flat geometry like plane.obj still has a box with some thickness
+        node.bounds_min = node.bounds_min - vector3(1e-6, 1e-6, 1e-6);
+        node.bounds_max = node.bounds_max + vector3(1e-6, 1e-6, 1e-6);
+    }
+
+    // median split along the longest axis of the triangle centroids
+    void subdivide(int node_index){
+        fit_node(node_index);
+
+        int first = nodes[node_index].first;
+        int count = nodes[node_index].count;
+
+        if (count <= bvh_leaf_size) return;
+
+        vector3 centroid_min(INFINITY, INFINITY, INFINITY);
+        vector3 centroid_max(-INFINITY, -INFINITY, -INFINITY);
+
+        for (int i = first; i < first + count; ++i){
+            centroid_min = min_vector3(centroid_min, triangles[i].centroid());
+            centroid_max = max_vector3(centroid_max, triangles[i].centroid());
+        }
+
+        vector3 extent = centroid_max - centroid_min;
+        int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+
+        if ((axis == 0 ? extent.x : axis == 1 ? extent.y : extent.z) <= 0) return;
+
+        vector<int> order(count);
+        for (int i = 0; i < count; ++i) order[i] = first + i;
+
+        auto centroid_on_axis = [&](int i){
+            vector3 centroid = triangles[i].centroid();
+            return axis == 0 ? centroid.x : axis == 1 ? centroid.y : centroid.z;
+        };
+
+        nth_element(order.begin(), order.begin() + count / 2, order.end(), [&](int a, int b){ return centroid_on_axis(a) < centroid_on_axis(b); });
+
+        // the original triangles and their sources get the same order so update() and shading keep lining up with the
+        // leaves
+        vector<Triangle_Record> sorted_triangles;
+        vector<Triangle> sorted_original_triangles;
+        vector<int> sorted_sources;
+        for (int i : order){
+            sorted_triangles.push_back(triangles[i]);
+            sorted_original_triangles.push_back(original_triangles[i]);
+            sorted_sources.push_back(sources[i]);
+        }
+
+        copy(sorted_triangles.begin(), sorted_triangles.end(), triangles.begin() + first);
+        copy(sorted_original_triangles.begin(), sorted_original_triangles.end(), original_triangles.begin() + first);
+        copy(sorted_sources.begin(), sorted_sources.end(), sources.begin() + first);
+
+        int left = nodes.size();
+        nodes.push_back(BVH_Node{vector3(), vector3(), first, count / 2});
+        nodes.push_back(BVH_Node{vector3(), vector3(), first + count / 2, count - count / 2});
+
+        nodes[node_index].first = left;
+        nodes[node_index].count = 0;
+
+        subdivide(left);
+        subdivide(left + 1);
+        fit_node(node_index);
+    }
+
+    // children always come after their parent, so walking backwards fits every child before its parent
+    void refit_bvh(){
+        for (int i = nodes.size() - 1; i >= 0; --i){
+            fit_node(i);
+        }
     }
 };  
 
+// normal starts out as the face normal and is swapped for the interpolated vertex normal by interpolate_attributes(),
+// face_normal is kept for offsetting new rays off the surface
 struct Hit{
     Object* object;
     vector3 normal;
     vector3 result;
     vector3 position;
+    vector3 face_normal;
+    vector2 uv;
+    int triangle;
 
-    Hit(Object* object=nullptr, vector3 normal=vector3(), vector3 position=vector3(), vector3 result=vector3(INFINITY, 0, 0)) : object(object), normal(normal), position(position), result(result) {}
+    Hit(Object* object=nullptr, vector3 normal=vector3(), vector3 position=vector3(), vector3 result=vector3(INFINITY, 0, 0), int triangle=-1) : object(object), normal(normal), position(position), result(result), face_normal(normal), triangle(triangle) {}
 };
 
 struct Ray{
-    vector<Hit> hits;
     vector3 position;
     vector3 origin;
     vector3 direction;
@@ -124,7 +479,9 @@ struct Camera{
     double resolution;
     double fov;
     double min_clip = 0;
+    double pixel_spread = 0;
     vector<Ray> rays;
+    // how many bounces deep reflected and refracted rays are followed, past that they count as a miss
     int max_reflections;
 
     void generate_rays(int width_half, int height_half) {
@@ -133,10 +490,16 @@ struct Camera{
         float aspect_ratio = static_cast<float>(width_half * 2) / static_cast<float>(height_half * 2);
         float x_increment = tan(fov / 2) / width_half;
         float y_increment = tan(fov / 2) / height_half / aspect_ratio;
+
+        pixel_spread = x_increment * resolution;
+
+        bool is_rotated = rotation.x != 0 || rotation.y != 0 || rotation.z != 0;
+        Basis basis = rotation_basis(rotation);
         
         for (int i = -width_half; i < width_half; i += resolution) {
             for (int j = -height_half; j < height_half; j += resolution) {
-                rays.push_back(Ray(position, vector3(x_increment * i, y_increment * j, 1).normalize(), i + width_half, j + height_half));
+                vector3 direction = vector3(x_increment * i, y_increment * j, 1).normalize();
+                rays.push_back(Ray(position, is_rotated ? basis.apply(direction) : direction, i + width_half, j + height_half));
             }
         }
     }
@@ -144,9 +507,58 @@ struct Camera{
     Camera(vector3 position, vector3 rotation, double resolution, double fov, int max_reflections) : position(position), rotation(rotation), resolution(resolution), fov(fov), max_reflections(max_reflections) {}
 };
 
-Camera camera(vector3(0, 0, -1410), vector3(0, 0, 0), 1, 1, 9);
+struct Render_Settings{
+    int width = 1000;
+    int height = 1000;
+    int thread_count = 20;
+    int denoise_iterations = 0;
+    bool wavefront = false;
+    bool incremental = false;
+    string output;
+};
+
+// what the last frame was traced with, so the next one only re-traces the camera rays that could have changed.
+// touched holds a bit per object (objects past 63 share the last bit) for every spinning object whose motion boxes any
+// ray in that camera ray's tree entered before its closest hit. objects that don't spin have no boxes, moving one
+// re-traces everything
+struct Object_State{
+    vector3 position;
+    vector3 rotation;
+    vector3 scale;
+    vector3 spin;
+    vector<BVH_Node> motion_boxes;
+};
+
+struct Light_State{
+    vector3 position;
+    double intensity;
+};
+
+struct Incremental_State{
+    bool valid = false;
+    bool has_buffers = false;
+    int width = 0;
+    int height = 0;
+    vector3 camera_position;
+    vector3 camera_rotation;
+    double camera_resolution = 0;
+    double camera_fov = 0;
+    int camera_max_reflections = 0;
+    vector<Object_State> objects;
+    vector<Light_State> lights;
+    vector<uint64_t> touched;
+    vector<Uint32> colors;
+};
+
+Camera camera(vector3(0, 0, -1410), vector3(0, 0, 0), 1, 1, 5);
 vector<Object> scene;
 vector<Light> lights;
+map<string, Mesh> meshes;
+Incremental_State incremental_state;
+// every spinning object's motion boxes in one list with the bit of the object each belongs to, what touched_objects
+// tests every ray against
+vector<BVH_Node> motion_boxes;
+vector<uint64_t> motion_box_bits;
 
 vector3 rotate_y(double angle, vector3 vector) {
     Matrix matrix = {
@@ -209,55 +621,157 @@ vector<string> split_string(string str, char delimiter){
     return parts;
 }
 
-vector<Triangle> read_object_file(string file_name){
+// one index of a face corner, obj counts from 1. an empty index (the vt in v//vn) comes back as -1, anything that isn't a
+// whole number fails
+bool read_face_index(string text, int& index){
+    index = -1;
+
+    if (text.empty()) return true;
+
+    char* end = nullptr;
+    long value = strtol(text.c_str(), &end, 10);
+
+    if (end == text.c_str() || *end != '\0' || value <= INT_MIN || value > INT_MAX) return false;
+
+    index = value - 1;
+
+    return true;
+}
+
+// fails when the file can't be opened, a line doesn't parse, a face points at a vertex that isn't there or there are no
+// faces at all. vn and vt lines go straight into the mesh's streams, a face's vt or vn index that is out of range is
+// treated as missing
+bool read_object_file(string file_name, Mesh& mesh){
     ifstream object_file(file_name);
     string line;
 
     vector<vector3> points;
-    vector<Triangle> triangles;
-
-    if (object_file.is_open()){
-        while(object_file.good()){
-            getline(object_file, line);
-            
-            if (line[0] == 'v' && line[1] == ' '){
-                istringstream iss(line);
-                string foo;
-                double x, y, z;
 
-                iss >> foo >> x >> y >> z;
+    if (!object_file.is_open()) return false;
 
-                points.push_back(vector3(x, y, z));
-            } else if (line[0] == 'f'){
-                line.erase(0, 2);
-                if (line.find('/') != string::npos) {
-                    vector<vector3> vectors;
+    while(object_file.good()){
+        getline(object_file, line);
 
-                    for (string point : split_string(line, ' ')) {
-                        vectors.push_back(points[stoi(split_string(point, '/')[0]) - 1]);
-                    }
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        
+        if (line[0] == 'v' && line[1] == ' '){
+            istringstream iss(line);
+            string foo;
+            double x, y, z;
+
+            if (!(iss >> foo >> x >> y >> z)) return false;
+
+            points.push_back(vector3(x, y, z));
+        } else if (line[0] == 'v' && line[1] == 'n'){
+            istringstream iss(line);
+            string foo;
+            double x, y, z;
+
+            if (!(iss >> foo >> x >> y >> z)) return false;
+
+            mesh.normal_x.push_back(x);
+            mesh.normal_y.push_back(y);
+            mesh.normal_z.push_back(z);
+        } else if (line[0] == 'v' && line[1] == 't'){
+            istringstream iss(line);
+            string foo;
+            double u, v;
+
+            if (!(iss >> foo >> u >> v)) return false;
+
+            mesh.uv_u.push_back(u);
+            mesh.uv_v.push_back(v);
+        } else if (line[0] == 'f'){
+            line.erase(0, 2);
+            if (line.find('/') != string::npos) {
+                vector<vector3> vectors;
+                vector<int> normal_indices;
+                vector<int> uv_indices;
+
+                // v/vt/vn, where vt and vn can be missing
+                for (string point : split_string(line, ' ')) {
+                    if (point.empty()) continue;
+
+                    vector<string> indices = split_string(point, '/');
+                    int point_index, uv_index = -1, normal_index = -1;
+
+                    if (indices.size() > 3 || !read_face_index(indices[0], point_index) ||
+                        (indices.size() > 1 && !read_face_index(indices[1], uv_index)) ||
+                        (indices.size() > 2 && !read_face_index(indices[2], normal_index))) return false;
+
+                    if (point_index < 0 || point_index >= (int)points.size()) return false;
+
+                    vectors.push_back(points[point_index]);
+                    uv_indices.push_back(uv_index >= 0 && uv_index < (int)mesh.uv_u.size() ? uv_index : -1);
+                    normal_indices.push_back(normal_index >= 0 && normal_index < (int)mesh.normal_x.size() ? normal_index : -1);
+                }
 
-                    if (vectors.size() >= 3) {
-                        triangles.push_back(Triangle(vectors[0], vectors[1], vectors[2]));
-                    }
+                if (vectors.size() >= 3) {
+                    mesh.triangles.push_back(Triangle(vectors[0], vectors[1], vectors[2]));
+                    mesh.normal_indices.insert(mesh.normal_indices.end(), normal_indices.begin(), normal_indices.begin() + 3);
+                    mesh.uv_indices.insert(mesh.uv_indices.end(), uv_indices.begin(), uv_indices.begin() + 3);
                 }
             }
         }
     }
 
-    return triangles;
+    // an attribute no face refers to is dropped altogether, so shading can tell from a null stream that there's nothing
+    // to interpolate
+    if (all_of(mesh.normal_indices.begin(), mesh.normal_indices.end(), [](int index){ return index < 0; })){
+        mesh.normal_indices.clear();
+        mesh.normal_x.clear();
+        mesh.normal_y.clear();
+        mesh.normal_z.clear();
+    }
+
+    if (all_of(mesh.uv_indices.begin(), mesh.uv_indices.end(), [](int index){ return index < 0; })){
+        mesh.uv_indices.clear();
+        mesh.uv_u.clear();
+        mesh.uv_v.clear();
+    }
+
+    return !mesh.triangles.empty();
 }
 
-void import_object(vector3 position, vector3 rotation, vector3 scale, string file_name, Material material){
-    Object object(position, rotation, scale, material, read_object_file(file_name));
+// meshes are cached by file name so a scene can instance the same .obj many times but only parse it once. returns
+// nullptr on failure, failures aren't cached so a fixed file is picked up when the scene is loaded again
+Mesh* load_mesh(string file_name){
+    auto mesh = meshes.find(file_name);
+
+    if (mesh != meshes.end()) return &mesh->second;
+
+    Mesh parsed;
+
+    if (!read_object_file(file_name, parsed)){
+        cerr << "could not read mesh " << file_name << endl;
+        return nullptr;
+    }
+
+    return &meshes.emplace(file_name, move(parsed)).first->second;
+}
+
+bool import_object(vector3 position, vector3 rotation, vector3 scale, string file_name, Material material, vector3 spin=vector3()){
+    Mesh* mesh = load_mesh(file_name);
+
+    if (mesh == nullptr) return false;
+
+    Object object(position, rotation, scale, material, mesh->triangles, spin);
+    object.streams = mesh->streams();
 
     object.update();
 
     scene.push_back(object);
+
+    return true;
 }
 
-void create_light(vector3 position, vector3 scale, Color color, double intensity){
-    Object object(position, vector3(), scale, Material(color, is_light), read_object_file("cube.obj"));
+bool create_light(vector3 position, vector3 scale, Color color, double intensity){
+    Mesh* mesh = load_mesh("cube.obj");
+
+    if (mesh == nullptr) return false;
+
+    Object object(position, vector3(), scale, Material(color, is_light), mesh->triangles);
+    object.streams = mesh->streams();
 
     scene.push_back(object);
     
@@ -266,187 +780,1370 @@ void create_light(vector3 position, vector3 scale, Color color, double intensity
     light.update();
 
     lights.push_back(light);
-}
 
-vector3 reflection(vector3 incident, vector3 normal){
-    return incident - 2 * normal * dot_product(incident, normal);
+    return true;
 }
 
-vector3 refraction(vector3 light_angle, vector3 normal, double refractive_index){
-    double cosi = max(-1.0, min(1.0, dot_product(light_angle, normal)));
-    double etai = 1;
-    double etat = refractive_index;
-    
-    if (cosi < 0){
-        cosi *= -1;
-        swap(etai, etat);
-        normal = normal * -1;
+struct Mapped_File{
+    void* data = nullptr;
+    size_t size = 0;
+};
+
+Mapped_File snapshot_mapping;
+
+void clear_scene(){
+    scene.clear();
+    lights.clear();
+    incremental_state.valid = false;
+
+    if (snapshot_mapping.data != nullptr){
+        munmap(snapshot_mapping.data, snapshot_mapping.size);
+        snapshot_mapping = Mapped_File();
     }
+}
 
-    double eta = etai / etat;
-    double k = 1 - pow(eta, 2) * (1 - pow(cosi, 2));
-    return k < 0 ? vector3(0, 0, 0) : light_angle * eta + normal * (eta * cosi - sqrt(k));
+bool read_material_flag(string name, Material_Flags& flag){
+    if (name == "lit") flag = is_lit;
+    else if (name == "unlit") flag = is_unlit;
+    else if (name == "uv") flag = is_showing_uv;
+    else if (name == "light") flag = is_light;
+    else return false;
+
+    return true;
 }
 
-Hit is_intersecting(Ray& ray){
-    Hit closest_hit;
+// scene files are plain text, one statement per line, '#' starts a comment. any statement that is unknown, malformed or
+// names a file that can't be read is reported with its line and fails the whole scene:
+//   render   width height thread_count
+//   denoise  iterations                    (a-trous passes run on frames where camera resolution is above 1)
+//   wavefront 0|1                          (trace the ray tree a depth at a time in sorted batches)
+//   incremental 0|1                        (only re-trace pixels whose rays touched an object that moved)
+//   output   file.ppm                      (render one frame to a file instead of opening a window)
+//   camera   px py pz  rx ry rz  resolution fov max_reflections   (radians, applied x then y then z like objects)
+//   material name  r g b  lit|unlit|uv|light  refractive_index diffuse specular reflective refractive specular_exponent [texture.ppm]
+//   object   file.obj  px py pz  rx ry rz  sx sy sz  material [spin_x spin_y spin_z]
+//   light    px py pz  sx sy sz  r g b  intensity
+// true once every field of a statement has been read and nothing but whitespace is left on its line
+bool is_at_end(istringstream& iss){
+    if (iss.fail()) return false;
+
+    // skipping whitespace on a stream that already hit the end would fail it, so only skip when there's more to read
+    return iss.eof() || (iss >> ws).eof();
+}
 
-    for (Object& object : scene) {
-        for(Triangle triangle : object.triangles){
-            vector3 E1 = triangle.vertex_2 - triangle.vertex_1;
-            vector3 E2 = triangle.vertex_3 - triangle.vertex_1;
-            vector3 T = ray.origin - triangle.vertex_1;
-            vector3 P = cross_multiply(ray.direction, E2);
-            vector3 Q = cross_multiply(T, E1);
-
-            vector3 result = 1 / dot_product(P, E1) * vector3(dot_product(Q, E2), dot_product(P, T), dot_product(Q, ray.direction));
-        
-            double t = result.x;
-            double u = result.y;
-            double v = result.z;
+bool read_scene_file(string file_name, Render_Settings& settings){
+    ifstream scene_file(file_name);
+
+    if (!scene_file.is_open()){
+        cerr << "could not open scene file " << file_name << endl;
+        return false;
+    }
+
+    struct Light_Description{
+        vector3 position;
+        vector3 scale;
+        Color color;
+        double intensity;
+        int line_number;
+    };
 
-            if (t > camera.min_clip && t < closest_hit.result.x && u>=0 && u<=1 && v>=0 && v<=1 && u+v>=0 && u+v<=1){
-                closest_hit = Hit(&object, triangle.normal, ray.direction * t + ray.origin, result);           
+    map<string, Material> materials;
+    vector<Light_Description> light_descriptions;
+    string line;
+    int line_number = 0;
+    int error_count = 0;
+
+    clear_scene();
+    settings = Render_Settings();
+    camera = Camera(vector3(0, 0, -1410), vector3(0, 0, 0), 1, 1, 5);
+
+    while (getline(scene_file, line)){
+        ++line_number;
+
+        size_t comment = line.find('#');
+        if (comment != string::npos) line.erase(comment);
+
+        istringstream iss(line);
+        string keyword;
+
+        if (!(iss >> keyword)) continue;
+
+        bool valid = true;
+
+        if (keyword == "render"){
+            valid = bool(iss >> settings.width >> settings.height >> settings.thread_count) && is_at_end(iss) && settings.width > 0 && settings.height > 0 && settings.thread_count > 0;
+        } else if (keyword == "denoise"){
+            valid = bool(iss >> settings.denoise_iterations) && is_at_end(iss) && settings.denoise_iterations >= 0;
+        } else if (keyword == "wavefront"){
+            valid = bool(iss >> settings.wavefront) && is_at_end(iss);
+        } else if (keyword == "incremental"){
+            valid = bool(iss >> settings.incremental) && is_at_end(iss);
+        } else if (keyword == "output"){
+            valid = bool(iss >> settings.output) && is_at_end(iss);
+        } else if (keyword == "camera"){
+            vector3 position, rotation;
+            double resolution, fov;
+            int max_reflections;
+
+            valid = bool(iss >> position.x >> position.y >> position.z >> rotation.x >> rotation.y >> rotation.z >> resolution >> fov >> max_reflections) && is_at_end(iss) &&
+                resolution >= 1 && max_reflections >= 0;
+            if (valid) camera = Camera(position, rotation, resolution, fov, max_reflections);
+        } else if (keyword == "material"){
+            string name, flag_name, texture_file;
+            int r, g, b;
+            Material_Flags flag;
+            double refractive_index, diffuse_albedo, specular_albedo, reflective_albedo, refractive_albedo, specular_exponent;
+
+            valid = bool(iss >> name >> r >> g >> b >> flag_name >> refractive_index >> diffuse_albedo >> specular_albedo >> reflective_albedo >> refractive_albedo >> specular_exponent) &&
+                read_material_flag(flag_name, flag);
+            if (valid && !is_at_end(iss)) iss >> texture_file;
+            valid = valid && is_at_end(iss);
+
+            int texture = valid && !texture_file.empty() ? load_texture(texture_file) : -1;
+            valid = valid && (texture_file.empty() || texture >= 0);
+
+            if (valid) materials.insert_or_assign(name, Material(Color(r, g, b), flag, refractive_index, diffuse_albedo, specular_albedo, reflective_albedo, refractive_albedo, specular_exponent, texture));
+        } else if (keyword == "object"){
+            string object_file, material_name;
+            vector3 position, rotation, scale, spin;
+
+            // the spin is all three angles or none
+            valid = bool(iss >> object_file >> position.x >> position.y >> position.z >> rotation.x >> rotation.y >> rotation.z >> scale.x >> scale.y >> scale.z >> material_name);
+            if (valid && !is_at_end(iss)) iss >> spin.x >> spin.y >> spin.z;
+            valid = valid && is_at_end(iss);
+
+            if (valid && materials.find(material_name) == materials.end()){
+                cerr << file_name << ":" << line_number << ": unknown material " << material_name << endl;
+                ++error_count;
+                continue;
             }
+
+            valid = valid && import_object(position, rotation, scale, object_file, materials.at(material_name), spin);
+        } else if (keyword == "light"){
+            Light_Description light;
+            int r, g, b;
+
+            valid = bool(iss >> light.position.x >> light.position.y >> light.position.z >> light.scale.x >> light.scale.y >> light.scale.z >> r >> g >> b >> light.intensity) && is_at_end(iss);
+            light.color = Color(r, g, b);
+            light.line_number = line_number;
+            if (valid) light_descriptions.push_back(light);
+        } else {
+            cerr << file_name << ":" << line_number << ": unknown statement " << keyword << endl;
+            ++error_count;
+            continue;
+        }
+
+        if (!valid){
+            cerr << file_name << ":" << line_number << ": malformed " << keyword << " statement" << endl;
+            ++error_count;
         }
     }
 
-    return closest_hit;
+    // lights keep a pointer to their object, so the scene can't reallocate once they're made
+    scene.reserve(scene.size() + light_descriptions.size());
+
+    for (Light_Description& light : light_descriptions){
+        if (!create_light(light.position, light.scale, light.color, light.intensity)){
+            cerr << file_name << ":" << light.line_number << ": malformed light statement" << endl;
+            ++error_count;
+        }
+    }
+
+    if (error_count > 0){
+        cerr << file_name << ": " << error_count << " bad statement" << (error_count == 1 ? "" : "s") << ", not loaded" << endl;
+        return false;
+    }
+
+    return true;
 }
 
-Color simple_cast(Ray ray){ 
-    if (ray.reflection > 5) return Color(0, 0, 20);
+// baked snapshots hold a whole scene with its world space triangles and built hierarchies, laid out so the file can be
+// mmapped read only and traced straight out of the page cache. everything is addressed by offsets from the start of the
+// file and stored in native layout, so a snapshot is only valid for the build that wrote it (bump the version when
+// Triangle, Triangle_Record, BVH_Node, Material or the structs below change)
+const char snapshot_magic[8] = {'R', 'T', 'B', 'A', 'K', 'E', 0, 0};
+const uint32_t snapshot_version = 10;
+
+struct Snapshot_Header{
+    char magic[8];
+    uint32_t version;
+    uint32_t object_count;
+    uint32_t light_count;
+    uint32_t texture_count;
+    uint32_t mesh_count;
+    int32_t width;
+    int32_t height;
+    int32_t thread_count;
+    int32_t denoise_iterations;
+    int32_t wavefront;
+    int32_t incremental;
+    char output[256];
+    vector3 camera_position;
+    vector3 camera_rotation;
+    double camera_resolution;
+    double camera_fov;
+    int32_t camera_max_reflections;
+    uint64_t objects_offset;
+    uint64_t lights_offset;
+    uint64_t textures_offset;
+    uint64_t meshes_offset;
+};
 
-    Hit hit = is_intersecting(ray);
+// materials refer to textures by their index in the cache, so the file names are stored to rebuild it on load
+struct Snapshot_Texture{
+    char file_name[256];
+};
 
-    if (hit.result.x == INFINITY) return Color(0, 0, 20);
+// the vertex attribute streams of one mesh, written once however many objects share them
+struct Snapshot_Mesh{
+    uint64_t normal_indices_offset;
+    uint64_t uv_indices_offset;
+    uint64_t normal_offsets[3];
+    uint64_t uv_offsets[2];
+    uint32_t triangle_count;
+    uint32_t normal_count;
+    uint32_t uv_count;
+};
 
-    ray.distance += hit.result.x;
+// only animated objects keep their object space triangles, static ones are traced directly from the mapping. mesh is
+// -1 for an object with neither vertex normals nor uvs, it then has no sources either
+struct Snapshot_Object{
+    Material material;
+    vector3 position;
+    vector3 rotation;
+    vector3 scale;
+    vector3 spin;
+    uint64_t triangles_offset;
+    uint64_t original_triangles_offset;
+    uint64_t nodes_offset;
+    uint64_t sources_offset;
+    uint32_t triangle_count;
+    uint32_t original_triangle_count;
+    uint32_t node_count;
+    int32_t mesh;
+};
 
-    switch (hit.object->material.flag) {
-        case is_lit: {
-            Material& material = hit.object->material;
+struct Snapshot_Light{
+    vector3 position;
+    Color color;
+    double intensity;
+    int32_t object;
+};
 
-            double diffuse_light_intensity = 0;
-            double specular_light_intensity = 0;
+uint64_t append_block(vector<char>& buffer, const void* data, size_t size){
+    buffer.resize((buffer.size() + 15) / 16 * 16);
 
-            for(Light& light : lights){
-                vector3 light_direction = (light.position - hit.position).normalize();
-                
-                Ray shadow_ray = dot_product(light_direction, hit.normal) < 0 ? Ray(hit.position - hit.normal * 1e-3, light_direction, 0, 0) : Ray(hit.position + hit.normal * 1e-3, light_direction, 0, 0);
-                Hit shadow_hit = is_intersecting(shadow_ray);
+    uint64_t offset = buffer.size();
+    buffer.insert(buffer.end(), (const char*)data, (const char*)data + size);
+
+    return offset;
+}
 
-                if (shadow_hit.result.x == INFINITY || (shadow_hit.object != nullptr && shadow_hit.object->material.flag == is_light)) {
-                    diffuse_light_intensity += light.intensity * (1 / pow(ray.distance, 0.5)) * max(0.0, dot_product(light_direction, hit.normal));
-                    specular_light_intensity += light.intensity * (1 / pow(ray.distance, 0.5)) * pow(max(0.0, dot_product(-1 * reflection(-1 * light_direction, hit.normal), ray.direction)), material.specular_exponent);                    
+bool write_snapshot_file(string file_name, Render_Settings& settings){
+    Snapshot_Header header{};
+    memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+    header.version = snapshot_version;
+    header.object_count = scene.size();
+    header.light_count = lights.size();
+    header.texture_count = textures.size();
+    header.width = settings.width;
+    header.height = settings.height;
+    header.thread_count = settings.thread_count;
+    header.denoise_iterations = settings.denoise_iterations;
+    header.wavefront = settings.wavefront;
+    header.incremental = settings.incremental;
+    strncpy(header.output, settings.output.c_str(), sizeof(header.output) - 1);
+    header.camera_position = camera.position;
+    header.camera_rotation = camera.rotation;
+    header.camera_resolution = camera.resolution;
+    header.camera_fov = camera.fov;
+    header.camera_max_reflections = camera.max_reflections;
+
+    vector<char> buffer(sizeof(Snapshot_Header));
+    vector<Snapshot_Object> objects;
+    vector<Snapshot_Light> snapshot_lights;
+    vector<Snapshot_Texture> snapshot_textures(textures.size(), Snapshot_Texture{});
+    vector<Snapshot_Mesh> snapshot_meshes;
+    map<pair<const int*, const int*>, int> mesh_ids;
+
+    for (Object& object : scene){
+        BVH bvh = object.bvh();
+        const Mesh_Streams& streams = object.streams;
+        bool animated = object.spin.x != 0 || object.spin.y != 0 || object.spin.z != 0;
+        int mesh = -1;
+
+        // objects made from the same mesh point at the same streams
+        if (bvh.sources != nullptr && (streams.normal_indices != nullptr || streams.uv_indices != nullptr)){
+            auto id = mesh_ids.find({streams.normal_indices, streams.uv_indices});
+
+            if (id == mesh_ids.end()){
+                Snapshot_Mesh snapshot_mesh{};
+                snapshot_mesh.triangle_count = streams.triangle_count;
+                snapshot_mesh.normal_count = streams.normal_count;
+                snapshot_mesh.uv_count = streams.uv_count;
+
+                if (streams.normal_indices != nullptr){
+                    snapshot_mesh.normal_indices_offset = append_block(buffer, streams.normal_indices, streams.triangle_count * 3 * sizeof(int));
+                    snapshot_mesh.normal_offsets[0] = append_block(buffer, streams.normal_x, streams.normal_count * sizeof(double));
+                    snapshot_mesh.normal_offsets[1] = append_block(buffer, streams.normal_y, streams.normal_count * sizeof(double));
+                    snapshot_mesh.normal_offsets[2] = append_block(buffer, streams.normal_z, streams.normal_count * sizeof(double));
                 }
-            }
 
-            Color reflected_color = Color(0, 0, 0);
-            if (material.reflective_albedo > 0){
-                vector3 reflection_direction = reflection(ray.direction, hit.normal).normalize();
-                Ray reflected_ray(hit.position + hit.normal*(dot_product(reflection_direction, hit.normal) < 0 ? -0.0000001 : 0.0000001), reflection_direction, 0, 0, ray.reflection + 1);
-                reflected_ray.distance += ray.distance;
-                reflected_color = simple_cast(reflected_ray);
-            }
+                if (streams.uv_indices != nullptr){
+                    snapshot_mesh.uv_indices_offset = append_block(buffer, streams.uv_indices, streams.triangle_count * 3 * sizeof(int));
+                    snapshot_mesh.uv_offsets[0] = append_block(buffer, streams.uv_u, streams.uv_count * sizeof(double));
+                    snapshot_mesh.uv_offsets[1] = append_block(buffer, streams.uv_v, streams.uv_count * sizeof(double));
+                }
 
-            Color refracted_color = Color(0, 0, 0);
-            if (material.refractive_albedo > 0){
-                vector3 refraction_direction = refraction(ray.direction, hit.normal, material.refractive_index).normalize();
-                Ray refracted_ray(hit.position + hit.normal * dot_product(refraction_direction, hit.normal), refraction_direction, 0, 0, ray.reflection + 1);
-                refracted_ray.distance += ray.distance;
-                refracted_color = simple_cast(refracted_ray);
+                id = mesh_ids.emplace(make_pair(streams.normal_indices, streams.uv_indices), snapshot_meshes.size()).first;
+                snapshot_meshes.push_back(snapshot_mesh);
             }
-                
-            Color final_color = material.color * diffuse_light_intensity * material.diffuse_albedo + Color(255, 255, 255) * specular_light_intensity * material.specular_albedo + reflected_color * material.reflective_albedo + refracted_color * material.refractive_albedo;
 
-            final_color.r = final_color.r > 255 ? 255 : final_color.r;
-            final_color.g = final_color.g > 255 ? 255 : final_color.g;
-            final_color.b = final_color.b > 255 ? 255 : final_color.b;
-
-            return final_color;
-        }
-        case is_unlit: {
-            return hit.object->material.color;
-        }
-        case is_light: {
-            return hit.object->material.color;
+            mesh = id->second;
         }
-        case is_showing_uv: {
-            vector3 result = hit.result;
-            double t = result.x;
-            double u = result.y;
-            double v = result.z;
 
-            return Color(255 * (1-(u+v)), 255 * (1-(u+(1-(u + v)))), 255 * (1-(v+(1-(u + v)))));
-        }
-        default: {
-            return Color(255, 0, 255);
-        }
+        objects.push_back(Snapshot_Object{object.material, object.position, object.rotation, object.scale, object.spin,
+            append_block(buffer, bvh.triangles, bvh.triangle_count * sizeof(Triangle_Record)),
+            animated ? append_block(buffer, object.original_triangles.data(), object.original_triangles.size() * sizeof(Triangle)) : 0,
+            append_block(buffer, bvh.nodes, bvh.node_count * sizeof(BVH_Node)),
+            mesh >= 0 ? append_block(buffer, bvh.sources, bvh.triangle_count * sizeof(int)) : 0,
+            uint32_t(bvh.triangle_count), animated ? uint32_t(object.original_triangles.size()) : 0, uint32_t(bvh.node_count), mesh});
     }
-}
 
-void simple_cast_thread(int x_start, int x_end, int width, int height, Uint32* pixels) {
-    int ray_count_width = width / camera.resolution;
-    
-    for (int i = x_start; i < x_end; i += camera.resolution) {
-        for (int j = 0; j < height; j += camera.resolution) {
-            Ray& ray = camera.rays[ray_count_width * (i / camera.resolution) + (j / camera.resolution)];
-            
-            Uint32 color = simple_cast(ray).to_hex();
+    for (auto& texture : texture_ids){
+        strncpy(snapshot_textures[texture.second].file_name, texture.first.c_str(), sizeof(Snapshot_Texture::file_name) - 1);
+    }
 
-            for (int k = 0; k < camera.resolution; ++k) {
-                for (int l = 0; l < camera.resolution; ++l) {
-                    int pixel_index = (height - ray.y - k) * width + (ray.x + l);
-                    if (pixel_index >= 0 && pixel_index < width * height) {
-                        pixels[pixel_index] = color;
-                    }
-                }
-            }
-        }
+    for (Light& light : lights){
+        snapshot_lights.push_back(Snapshot_Light{light.position, light.color, light.intensity, int32_t(light.object - scene.data())});
     }
-}
 
-int main() { 
-    // refractive_index, diffuse_albedo, specular_albedo, reflective_albedo, refractive_albedo, specular_exponent
-    Material defualt(Color(222, 222, 214), is_lit, 1, 0.6, 0.3, 0.0, 0.0, 10);
-    Material gordon (Color(255, 255, 255), is_lit, 1.6, 0.3, 0.5, 0.2, 0.8, 10);
-    Material red    (Color(255, 0, 0),     is_lit, 1, 0.9, 0.1, 0.0, 0.0, 10);
-    Material green  (Color(0, 255, 0),     is_lit, 1, 0.9, 0.5, 0.1, 0.0, 100);
-    Material mirror (Color(0, 255, 0),     is_lit, 1, 0.0, 1.0, 0.7, 0.0, 2025);
+    header.objects_offset = append_block(buffer, objects.data(), objects.size() * sizeof(Snapshot_Object));
+    header.lights_offset = append_block(buffer, snapshot_lights.data(), snapshot_lights.size() * sizeof(Snapshot_Light));
+    header.textures_offset = append_block(buffer, snapshot_textures.data(), snapshot_textures.size() * sizeof(Snapshot_Texture));
+    header.mesh_count = snapshot_meshes.size();
+    header.meshes_offset = append_block(buffer, snapshot_meshes.data(), snapshot_meshes.size() * sizeof(Snapshot_Mesh));
+    memcpy(buffer.data(), &header, sizeof(header));
 
-     //import_object(vector3(0, 0, 0), vector3(0, 0, 0), vector3(100, 100, 100), "cube.obj", Material(Color(0, 255, 0), is_lit));
-     import_object(vector3(0, -500, 0), vector3(0, 3.14, 0), vector3(400, 400, 400), "gordon_freeman.obj", gordon);
-     import_object(vector3(0, -500, 0), vector3(0, 0, 0), vector3(500, 500, 500), "plane.obj", defualt);
-     import_object(vector3(0, 0, 500), vector3(1.57, 3.14, 0), vector3(500, 500, 500), "plane.obj", defualt);
-     import_object(vector3(0, 500, 0), vector3(0, 0, 0), vector3(500, 1, 500), "cube.obj", defualt);
-     import_object(vector3(-500, 0, 0), vector3(0, 0, -1.57), vector3(500, 500, 500), "plane.obj", red);
-     import_object(vector3(500, 0, 0), vector3(0, 0, 1.57), vector3(500, 500, 500), "plane.obj", green);
-     import_object(vector3(-250, 0, 250), vector3(1.57, -1.57 / 2, 0), vector3(500, 1, 500), "cube.obj", mirror);
-    //import_object(vector3(0, -300, 0), vector3(0, 3.14, 0), vector3(300, 200, 200), "cube.obj", defualt);
-    //import_object(vector3(0, -500, 0), vector3(0, 0, 0), vector3(500, 500, 500), "plane.obj", defualt);
-    //import_object(vector3(0, 0, 500), vector3(1.57, 3.14, 0), vector3(500, 500, 500), "plane.obj", defualt);
-    //import_object(vector3(0, 500, 0), vector3(0, 0, 0), vector3(500, 1, 500), "cube.obj", defualt);
-    //import_object(vector3(-500, 0, 0), vector3(0, 0, -1.57), vector3(500, 500, 500), "plane.obj", defualt);
-    //import_object(vector3(500, 0, 0), vector3(0, 0, 1.57), vector3(500, 500, 500), "plane.obj", defualt);
+    ofstream snapshot_file(file_name, ios::binary);
 
-    create_light(vector3(0, 500, 0), vector3(200, 10, 200), Color(255, 255, 255), 40);
+    if (!snapshot_file.is_open()){
+        cerr << "could not write " << file_name << endl;
+        return false;
+    }
 
-    camera.resolution = 1;
+    snapshot_file.write(buffer.data(), buffer.size());
 
-    init();
+    return bool(snapshot_file);
+}
 
-    TTF_Init();
+bool is_snapshot_file(string file_name){
+    ifstream snapshot_file(file_name, ios::binary);
+    char magic[sizeof(snapshot_magic)] = {};
 
-    TTF_Font* font = TTF_OpenFont("GaMaamli-Regular.ttf", 24);
+    snapshot_file.read(magic, sizeof(magic));
 
-    char angle_text[32];
-    int width = 1000;
-    int height = 1000;
-    int width_half = width / 2;
-    int height_half = height / 2;
+    return memcmp(magic, snapshot_magic, sizeof(snapshot_magic)) == 0;
+}
+
+// traversal trusts the hierarchy, so a snapshot's has to be checked before anything walks it. children always come
+// after their parent, which rules out cycles and lets one forward pass work out every node's depth
+bool is_valid_hierarchy(const BVH_Node* nodes, int64_t node_count, int64_t triangle_count){
+    vector<int> depths(node_count, 0);
+
+    for (int64_t i = 0; i < node_count; ++i){
+        const BVH_Node& node = nodes[i];
+
+        if (node.count < 0) return false;
+
+        if (node.count > 0){
+            if (node.first < 0 || node.first + int64_t(node.count) > triangle_count) return false;
+            continue;
+        }
+
+        // both children go on the traversal stack at once, so it needs room for one more entry than the depth
+        if (node.first <= i || node.first + int64_t(1) >= node_count || depths[i] + 2 > bvh_stack_size) return false;
+
+        depths[node.first] = max(depths[node.first], depths[i] + 1);
+        depths[node.first + 1] = max(depths[node.first + 1], depths[i] + 1);
+    }
+
+    return true;
+}
+
+bool read_snapshot_file(string file_name, Render_Settings& settings){
+    clear_scene();
+
+    int file = open(file_name.c_str(), O_RDONLY);
+    struct stat file_stat;
+
+    if (file < 0 || fstat(file, &file_stat) != 0 || size_t(file_stat.st_size) < sizeof(Snapshot_Header)){
+        cerr << "could not open snapshot " << file_name << endl;
+        if (file >= 0) ::close(file);
+        return false;
+    }
+
+    // a shared read only mapping lets every process rendering this snapshot use the same pages
+    void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file);
+
+    if (data == MAP_FAILED){
+        cerr << "could not map snapshot " << file_name << endl;
+        return false;
+    }
+
+    snapshot_mapping.data = data;
+    snapshot_mapping.size = file_stat.st_size;
+
+    const char* base = (const char*)data;
+    const Snapshot_Header& header = *(const Snapshot_Header*)base;
+
+    if (memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0 || header.version != snapshot_version){
+        cerr << file_name << ": snapshot version " << header.version << " doesn't match this build (" << snapshot_version << "), re-bake it" << endl;
+        clear_scene();
+        return false;
+    }
+
+    auto in_file = [&](uint64_t offset, uint64_t count, size_t element_size){
+        return offset % 8 == 0 && offset <= snapshot_mapping.size && count <= (snapshot_mapping.size - offset) / element_size;
+    };
+
+    if (!in_file(header.objects_offset, header.object_count, sizeof(Snapshot_Object)) || !in_file(header.lights_offset, header.light_count, sizeof(Snapshot_Light)) ||
+        !in_file(header.textures_offset, header.texture_count, sizeof(Snapshot_Texture)) || !in_file(header.meshes_offset, header.mesh_count, sizeof(Snapshot_Mesh))){
+        cerr << file_name << ": truncated snapshot" << endl;
+        clear_scene();
+        return false;
+    }
+
+    if (header.width <= 0 || header.height <= 0 || header.thread_count <= 0 || header.denoise_iterations < 0 ||
+        !(header.camera_resolution >= 1) || header.camera_max_reflections < 0){
+        cerr << file_name << ": invalid render settings in snapshot" << endl;
+        clear_scene();
+        return false;
+    }
+
+    settings = Render_Settings();
+    settings.width = header.width;
+    settings.height = header.height;
+    settings.thread_count = header.thread_count;
+    settings.denoise_iterations = header.denoise_iterations;
+    settings.wavefront = header.wavefront;
+    settings.incremental = header.incremental;
+    settings.output = string(header.output, strnlen(header.output, sizeof(header.output)));
+    camera = Camera(header.camera_position, header.camera_rotation, header.camera_resolution, header.camera_fov, header.camera_max_reflections);
+
+    const Snapshot_Object* objects = (const Snapshot_Object*)(base + header.objects_offset);
+    const Snapshot_Light* snapshot_lights = (const Snapshot_Light*)(base + header.lights_offset);
+    const Snapshot_Texture* snapshot_textures = (const Snapshot_Texture*)(base + header.textures_offset);
+    vector<int> texture_remap;
+
+    for (uint32_t i = 0; i < header.texture_count; ++i){
+        texture_remap.push_back(load_texture(string(snapshot_textures[i].file_name, strnlen(snapshot_textures[i].file_name, sizeof(Snapshot_Texture::file_name)))));
+
+        if (texture_remap.back() < 0){
+            cerr << file_name << ": texture " << i << " is missing" << endl;
+            clear_scene();
+            return false;
+        }
+    }
+
+    // every index shading follows into a mesh is checked here so shading never has to. attribute indices can be -1
+    auto is_valid_indices = [&](const int* indices, uint64_t count, int lowest, uint32_t limit){
+        for (uint64_t i = 0; i < count; ++i){
+            if (indices[i] < lowest || indices[i] >= int64_t(limit)) return false;
+        }
+
+        return true;
+    };
+
+    const Snapshot_Mesh* snapshot_meshes = (const Snapshot_Mesh*)(base + header.meshes_offset);
+    vector<Mesh_Streams> mesh_streams;
+
+    for (uint32_t i = 0; i < header.mesh_count; ++i){
+        const Snapshot_Mesh& mesh = snapshot_meshes[i];
+        uint64_t corner_count = uint64_t(mesh.triangle_count) * 3;
+        Mesh_Streams streams;
+        bool valid = mesh.triangle_count <= INT_MAX && mesh.normal_count <= INT_MAX && mesh.uv_count <= INT_MAX;
+
+        streams.triangle_count = mesh.triangle_count;
+        streams.normal_count = mesh.normal_count;
+        streams.uv_count = mesh.uv_count;
+
+        if (valid && mesh.normal_count > 0){
+            valid = in_file(mesh.normal_indices_offset, corner_count, sizeof(int)) && in_file(mesh.normal_offsets[0], mesh.normal_count, sizeof(double)) &&
+                in_file(mesh.normal_offsets[1], mesh.normal_count, sizeof(double)) && in_file(mesh.normal_offsets[2], mesh.normal_count, sizeof(double)) &&
+                is_valid_indices((const int*)(base + mesh.normal_indices_offset), corner_count, -1, mesh.normal_count);
+
+            streams.normal_indices = (const int*)(base + mesh.normal_indices_offset);
+            streams.normal_x = (const double*)(base + mesh.normal_offsets[0]);
+            streams.normal_y = (const double*)(base + mesh.normal_offsets[1]);
+            streams.normal_z = (const double*)(base + mesh.normal_offsets[2]);
+        }
+
+        if (valid && mesh.uv_count > 0){
+            valid = in_file(mesh.uv_indices_offset, corner_count, sizeof(int)) && in_file(mesh.uv_offsets[0], mesh.uv_count, sizeof(double)) &&
+                in_file(mesh.uv_offsets[1], mesh.uv_count, sizeof(double)) && is_valid_indices((const int*)(base + mesh.uv_indices_offset), corner_count, -1, mesh.uv_count);
+
+            streams.uv_indices = (const int*)(base + mesh.uv_indices_offset);
+            streams.uv_u = (const double*)(base + mesh.uv_offsets[0]);
+            streams.uv_v = (const double*)(base + mesh.uv_offsets[1]);
+        }
+
+        if (!valid){
+            cerr << file_name << ": mesh " << i << " is corrupt" << endl;
+            clear_scene();
+            return false;
+        }
+
+        mesh_streams.push_back(streams);
+    }
+
+    scene.reserve(header.object_count);
+
+    for (uint32_t i = 0; i < header.object_count; ++i){
+        const Snapshot_Object& snapshot_object = objects[i];
+
+        if (!in_file(snapshot_object.triangles_offset, snapshot_object.triangle_count, sizeof(Triangle_Record)) ||
+            !in_file(snapshot_object.original_triangles_offset, snapshot_object.original_triangle_count, sizeof(Triangle)) ||
+            !in_file(snapshot_object.nodes_offset, snapshot_object.node_count, sizeof(BVH_Node)) ||
+            (snapshot_object.mesh >= 0 && !in_file(snapshot_object.sources_offset, snapshot_object.triangle_count, sizeof(int)))){
+            cerr << file_name << ": truncated snapshot" << endl;
+            clear_scene();
+            return false;
+        }
+
+        bool has_mesh = snapshot_object.mesh >= 0 && snapshot_object.mesh < int64_t(header.mesh_count);
+
+        if ((snapshot_object.original_triangle_count != 0 && snapshot_object.original_triangle_count != snapshot_object.triangle_count) ||
+            (snapshot_object.mesh != -1 && !has_mesh) ||
+            (has_mesh && !is_valid_indices((const int*)(base + snapshot_object.sources_offset), snapshot_object.triangle_count, 0, mesh_streams[snapshot_object.mesh].triangle_count)) ||
+            snapshot_object.material.texture < -1 || snapshot_object.material.texture >= int64_t(header.texture_count) ||
+            !is_valid_hierarchy((const BVH_Node*)(base + snapshot_object.nodes_offset), snapshot_object.node_count, snapshot_object.triangle_count)){
+            cerr << file_name << ": object " << i << " is corrupt" << endl;
+            clear_scene();
+            return false;
+        }
+
+        const Triangle_Record* triangles = (const Triangle_Record*)(base + snapshot_object.triangles_offset);
+        const Triangle* original_triangles = (const Triangle*)(base + snapshot_object.original_triangles_offset);
+        const BVH_Node* nodes = (const BVH_Node*)(base + snapshot_object.nodes_offset);
+        const int* sources = has_mesh ? (const int*)(base + snapshot_object.sources_offset) : nullptr;
+
+        Material material = snapshot_object.material;
+        if (material.texture >= 0) material.texture = texture_remap[material.texture];
+
+        Object object(snapshot_object.position, snapshot_object.rotation, snapshot_object.scale, material,
+            vector<Triangle>(original_triangles, original_triangles + snapshot_object.original_triangle_count), snapshot_object.spin);
+
+        if (has_mesh) object.streams = mesh_streams[snapshot_object.mesh];
+        object.basis = rotation_basis(object.rotation);
+
+        // animated objects get their own copy since update() rewrites them every frame
+        if (snapshot_object.original_triangle_count > 0){
+            object.triangles.assign(triangles, triangles + snapshot_object.triangle_count);
+            object.nodes.assign(nodes, nodes + snapshot_object.node_count);
+            if (has_mesh) object.sources.assign(sources, sources + snapshot_object.triangle_count);
+        } else {
+            object.mapped = BVH{triangles, nodes, int(snapshot_object.triangle_count), int(snapshot_object.node_count), sources};
+        }
+
+        scene.push_back(object);
+    }
+
+    for (uint32_t i = 0; i < header.light_count; ++i){
+        const Snapshot_Light& light = snapshot_lights[i];
+        Object* object = light.object >= 0 && uint32_t(light.object) < header.object_count ? &scene[light.object] : nullptr;
+
+        if (object == nullptr){
+            cerr << file_name << ": light " << i << " has no object" << endl;
+            clear_scene();
+            return false;
+        }
+
+        lights.push_back(Light(light.position, light.color, light.intensity, object));
+    }
+
+    return true;
+}
+
+vector3 reflection(vector3 incident, vector3 normal){
+    return incident - 2 * normal * dot_product(incident, normal);
+}
+
+vector3 refraction(vector3 light_angle, vector3 normal, double refractive_index){
+    double cosi = max(-1.0, min(1.0, dot_product(light_angle, normal)));
+    double etai = 1;
+    double etat = refractive_index;
+    
+    if (cosi < 0){
+        cosi *= -1;
+        swap(etai, etat);
+        normal = normal * -1;
+    }
+
+    double eta = etai / etat;
+    double k = 1 - pow(eta, 2) * (1 - pow(cosi, 2));
+    return k < 0 ? vector3(0, 0, 0) : light_angle * eta + normal * (eta * cosi - sqrt(k));
+}
+
+// slab test, directions are clamped away from zero instead of relying on infinities since the build uses -Ofast
+vector3 inverse_direction(vector3 direction){
+    return vector3(1 / (fabs(direction.x) > 1e-12 ? direction.x : copysign(1e-12, direction.x)),
+                   1 / (fabs(direction.y) > 1e-12 ? direction.y : copysign(1e-12, direction.y)),
+                   1 / (fabs(direction.z) > 1e-12 ? direction.z : copysign(1e-12, direction.z)));
+}
+
+bool is_intersecting_box(const BVH_Node& node, Ray& ray, vector3 inverse_direction, double closest){
+    vector3 t1 = (node.bounds_min - ray.origin) * inverse_direction;
+    vector3 t2 = (node.bounds_max - ray.origin) * inverse_direction;
+    vector3 t_min = min_vector3(t1, t2);
+    vector3 t_max = max_vector3(t1, t2);
+
+    double t_near = max(t_min.x, max(t_min.y, t_min.z));
+    double t_far = min(t_max.x, min(t_max.y, t_max.z));
+
+    return t_far >= t_near && t_far > camera.min_clip && t_near < closest;
+}
+
+Hit is_intersecting(Ray& ray){
+    Hit closest_hit;
+    vector3 inverse = inverse_direction(ray.direction);
+
+    for (Object& object : scene) {
+        BVH bvh = object.bvh();
+
+        if (bvh.node_count == 0) continue;
+
+        int stack[bvh_stack_size];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while (stack_size > 0){
+            const BVH_Node& node = bvh.nodes[stack[--stack_size]];
+
+            if (!is_intersecting_box(node, ray, inverse, closest_hit.result.x)) continue;
+
+            if (node.count == 0){
+                stack[stack_size++] = node.first + 1;
+                stack[stack_size++] = node.first;
+                continue;
+            }
+
+            for (int i = node.first; i < node.first + node.count; ++i){
+                const Triangle_Record& triangle = bvh.triangles[i];
+                const vector3& E1 = triangle.edge_1;
+                const vector3& E2 = triangle.edge_2;
+                vector3 P = cross_multiply(ray.direction, E2);
+                double determinant = dot_product(P, E1);
+
+                // the ray is parallel to the triangle or the triangle has no area, either way 1 / determinant is useless
+                if (fabs(determinant) < 1e-12) continue;
+
+                vector3 T = ray.origin - triangle.vertex_1;
+                vector3 Q = cross_multiply(T, E1);
+
+                vector3 result = 1 / determinant * vector3(dot_product(Q, E2), dot_product(P, T), dot_product(Q, ray.direction));
+            
+                double t = result.x;
+                double u = result.y;
+                double v = result.z;
+
+                if (t > camera.min_clip && t < closest_hit.result.x && u>=0 && u<=1 && v>=0 && v<=1 && u+v>=0 && u+v<=1){
+                    closest_hit = Hit(&object, triangle.normal, ray.direction * t + ray.origin, result, i);           
+                }
+            }
+        }
+    }
+
+    return closest_hit;
+}
+
+// barycentric interpolation of the vertex attributes, only done for hits that get shaded
+void interpolate_attributes(Hit& hit){
+    Object& object = *hit.object;
+    const Mesh_Streams& streams = object.streams;
+    BVH bvh = object.bvh();
+
+    if (bvh.sources == nullptr) return;
+
+    int index = bvh.sources[hit.triangle] * 3;
+    double u = hit.result.y;
+    double v = hit.result.z;
+    double w = 1 - u - v;
+
+    if (streams.uv_indices != nullptr){
+        vector2 uv_1 = streams.uv(streams.uv_indices[index]), uv_2 = streams.uv(streams.uv_indices[index + 1]), uv_3 = streams.uv(streams.uv_indices[index + 2]);
+        hit.uv = uv_1 * w + uv_2 * u + uv_3 * v;
+    }
+
+    if (streams.normal_indices != nullptr){
+        // normals take the inverse of the scale so they stay perpendicular when the scale isn't uniform
+        vector3 normal_1 = object.basis.apply(streams.normal(streams.normal_indices[index]) / object.scale).normalize();
+        vector3 normal_2 = object.basis.apply(streams.normal(streams.normal_indices[index + 1]) / object.scale).normalize();
+        vector3 normal_3 = object.basis.apply(streams.normal(streams.normal_indices[index + 2]) / object.scale).normalize();
+        vector3 normal = normal_1 * w + normal_2 * u + normal_3 * v;
+
+        // corners without vn count as zero normals, a face with none keeps the flat face normal
+        if (normal.magnitude() > 1e-9) hit.normal = normal.normalize();
+    }
+}
+
+// picks the mip level from how much of the texture one pixel's footprint covers at the hit
+Color material_color(Material& material, Hit& hit, Ray& ray){
+    if (material.texture < 0) return material.color;
+
+    const Texture& texture = textures[material.texture];
+    BVH bvh = hit.object->bvh();
+    const Triangle_Record& triangle = bvh.triangles[hit.triangle];
+
+    double lod = 0;
+
+    const Mesh_Streams& streams = hit.object->streams;
+
+    if (streams.uv_indices != nullptr && bvh.sources != nullptr){
+        int index = bvh.sources[hit.triangle] * 3;
+        vector2 uv_1 = streams.uv(streams.uv_indices[index]), uv_2 = streams.uv(streams.uv_indices[index + 1]), uv_3 = streams.uv(streams.uv_indices[index + 2]);
+        vector2 uv_edge_1 = uv_2 - uv_1, uv_edge_2 = uv_3 - uv_1;
+        double uv_area = fabs(uv_edge_1.x * uv_edge_2.y - uv_edge_1.y * uv_edge_2.x) * texture.levels[0].width * texture.levels[0].height;
+        double world_area = cross_multiply(triangle.edge_1, triangle.edge_2).magnitude();
+        double footprint = ray.distance * camera.pixel_spread / max(0.1, fabs(dot_product(ray.direction, hit.face_normal)));
+
+        if (world_area > 0 && uv_area > 0) lod = log2(footprint * sqrt(uv_area / world_area));
+    }
+
+    Color texel = sample_texture(texture, hit.uv, lod);
+
+    return Color(material.color.r * texel.r / 255, material.color.g * texel.g / 255, material.color.b * texel.b / 255);
+}
+
+// what a primary ray hit, handed to the denoiser as its guide buffers
+struct Surface{
+    vector3 normal = vector3(0, 0, -1);
+    double depth = 1e30;
+    int object = -1;
+    Color albedo = Color(0, 0, 20);
+};
+
+// the pieces of shading a hit, shared by simple_cast and the wavefront renderer so both produce the same image
+Ray shadow_ray(Hit& hit, vector3 light_direction){
+    return dot_product(light_direction, hit.face_normal) < 0 ? Ray(hit.position - hit.face_normal * 1e-3, light_direction, 0, 0) : Ray(hit.position + hit.face_normal * 1e-3, light_direction, 0, 0);
+}
+
+bool is_reaching_light(Hit& shadow_hit){
+    return shadow_hit.result.x == INFINITY || (shadow_hit.object != nullptr && shadow_hit.object->material.flag == is_light);
+}
+
+void add_light(Light& light, Ray& ray, Hit& hit, vector3 light_direction, double& diffuse_light_intensity, double& specular_light_intensity){
+    Material& material = hit.object->material;
+
+    diffuse_light_intensity += light.intensity * (1 / pow(ray.distance, 0.5)) * max(0.0, dot_product(light_direction, hit.normal));
+    specular_light_intensity += light.intensity * (1 / pow(ray.distance, 0.5)) * pow(max(0.0, dot_product(-1 * reflection(-1 * light_direction, hit.normal), ray.direction)), material.specular_exponent);                    
+}
+
+Ray reflected_ray(Ray& ray, Hit& hit){
+    vector3 reflection_direction = reflection(ray.direction, hit.normal).normalize();
+    Ray reflected_ray(hit.position + hit.face_normal*(dot_product(reflection_direction, hit.face_normal) < 0 ? -0.0000001 : 0.0000001), reflection_direction, ray.x, ray.y, ray.reflection + 1);
+    reflected_ray.distance += ray.distance;
+    return reflected_ray;
+}
+
+Ray refracted_ray(Ray& ray, Hit& hit){
+    vector3 refraction_direction = refraction(ray.direction, hit.normal, hit.object->material.refractive_index).normalize();
+    Ray refracted_ray(hit.position + hit.face_normal * dot_product(refraction_direction, hit.face_normal), refraction_direction, ray.x, ray.y, ray.reflection + 1);
+    refracted_ray.distance += ray.distance;
+    return refracted_ray;
+}
+
+Color lit_color(Material& material, Color color, double diffuse_light_intensity, double specular_light_intensity, Color reflected_color, Color refracted_color){
+    Color final_color = color * diffuse_light_intensity * material.diffuse_albedo + Color(255, 255, 255) * specular_light_intensity * material.specular_albedo + reflected_color * material.reflective_albedo + refracted_color * material.refractive_albedo;
+
+    final_color.r = final_color.r > 255 ? 255 : final_color.r;
+    final_color.g = final_color.g > 255 ? 255 : final_color.g;
+    final_color.b = final_color.b > 255 ? 255 : final_color.b;
+
+    return final_color;
+}
+
+// everything but is_lit, which needs shadow and secondary rays
+Color unlit_color(Hit& hit, Color color){
+    switch (hit.object->material.flag) {
+        case is_unlit: {
+            return color;
+        }
+        case is_light: {
+            return hit.object->material.color;
+        }
+        case is_showing_uv: {
+            vector3 result = hit.result;
+            double t = result.x;
+            double u = result.y;
+            double v = result.z;
+
+            return Color(255 * (1-(u+v)), 255 * (1-(u+(1-(u + v)))), 255 * (1-(v+(1-(u + v)))));
+        }
+        default: {
+            return Color(255, 0, 255);
+        }
+    }
+}
+
+uint64_t object_bit(int index){
+    return uint64_t(1) << min(index, 63);
+}
+
+// every spinning object whose motion boxes the ray enters before its closest hit, turning any of them could change
+// what it hits
+uint64_t touched_objects(Ray& ray, double closest){
+    if (motion_boxes.empty()) return 0;
+
+    uint64_t touched = 0;
+    vector3 inverse = inverse_direction(ray.direction);
+
+    for (int i = 0; i < (int)motion_boxes.size(); ++i){
+        if ((touched & motion_box_bits[i]) != 0) continue;
+
+        if (is_intersecting_box(motion_boxes[i], ray, inverse, closest)) touched |= motion_box_bits[i];
+    }
+
+    return touched;
+}
+
+// touched is only given by the incremental renderer, which needs to know every object the ray tree depended on
+Color simple_cast(Ray ray, Surface* surface=nullptr, uint64_t* touched=nullptr){ 
+    if (ray.reflection > camera.max_reflections) return Color(0, 0, 20);
+
+    Hit hit = is_intersecting(ray);
+
+    if (touched != nullptr) *touched |= touched_objects(ray, hit.result.x);
+
+    if (hit.result.x == INFINITY) return Color(0, 0, 20);
+
+    ray.distance += hit.result.x;
+
+    interpolate_attributes(hit);
+
+    Color color = material_color(hit.object->material, hit, ray);
+
+    if (surface != nullptr){
+        *surface = Surface{hit.normal, ray.distance, int(hit.object - scene.data()), color};
+    }
+
+    if (hit.object->material.flag != is_lit) return unlit_color(hit, color);
+
+    Material& material = hit.object->material;
+
+    double diffuse_light_intensity = 0;
+    double specular_light_intensity = 0;
+
+    for(Light& light : lights){
+        vector3 light_direction = (light.position - hit.position).normalize();
+        
+        Ray shadow = shadow_ray(hit, light_direction);
+        Hit shadow_hit = is_intersecting(shadow);
+
+        if (touched != nullptr) *touched |= touched_objects(shadow, shadow_hit.result.x);
+
+        if (is_reaching_light(shadow_hit)) {
+            add_light(light, ray, hit, light_direction, diffuse_light_intensity, specular_light_intensity);
+        }
+    }
+
+    Color reflected_color = Color(0, 0, 0);
+    if (material.reflective_albedo > 0){
+        reflected_color = simple_cast(reflected_ray(ray, hit), nullptr, touched);
+    }
+
+    Color refracted_color = Color(0, 0, 0);
+    if (material.refractive_albedo > 0){
+        refracted_color = simple_cast(refracted_ray(ray, hit), nullptr, touched);
+    }
+        
+    return lit_color(material, color, diffuse_light_intensity, specular_light_intensity, reflected_color, refracted_color);
+}
 
-    camera.generate_rays(width_half, height_half);
+void write_pixel_block(Ray& ray, Uint32 color, int width, int height, Uint32* pixels){
+    for (int k = 0; k < camera.resolution; ++k) {
+        for (int l = 0; l < camera.resolution; ++l) {
+            int pixel_index = (height - ray.y - k) * width + (ray.x + l);
+            if (pixel_index >= 0 && pixel_index < width * height) {
+                pixels[pixel_index] = color;
+            }
+        }
+    }
+}
+
+// the denoiser keeps one cell per camera ray, generate_rays puts a ray every camera.resolution pixels from the corner
+int ray_grid_size(int size){
+    int resolution = camera.resolution;
+    return (size / 2 * 2 + resolution - 1) / resolution;
+}
+
+int ray_grid_index(Ray& ray, Denoise_Buffers& buffers){
+    int resolution = camera.resolution;
+    return ray.y / resolution * buffers.width + ray.x / resolution;
+}
+
+// a frame that will be denoised goes to the ray grid first, render_frame writes the filtered blocks out afterwards
+void write_ray(Ray& ray, Uint32 color, Surface& surface, int width, int height, Uint32* pixels, Denoise_Buffers* buffers){
+    if (buffers == nullptr){
+        write_pixel_block(ray, color, width, height, pixels);
+        return;
+    }
+
+    int index = ray_grid_index(ray, *buffers);
+    buffers->set(index, surface.normal, surface.depth, surface.object, surface.albedo);
+    buffers->set_color(index, color);
+}
+
+// threads get ranges of camera.rays rather than of pixel columns, each ray knows which pixels it covers. splitting by
+// column picked the wrong rays whenever a split didn't land on a multiple of the camera resolution
+void simple_cast_thread(int first_ray, int last_ray, int width, int height, Uint32* pixels, Denoise_Buffers* buffers) {
+    for (int i = first_ray; i < last_ray; ++i) {
+        Ray& ray = camera.rays[i];
+
+        Surface surface;
+        Uint32 color = simple_cast(ray, buffers != nullptr ? &surface : nullptr).to_hex();
+
+        write_ray(ray, color, surface, width, height, pixels, buffers);
+    }
+}
+
+// the wavefront renderer traces a whole depth of the ray tree at once instead of finishing each pixel depth first.
+// every depth's rays, and the shadow rays for each light, are sorted so neighbouring rays in the queue start close
+// together and point the same way, then intersected as a batch. the tree is resolved bottom up at the end with the
+// same shading code simple_cast uses, so both give the same image. it is off by default: with one scalar
+// is_intersecting per ray the sorting and per-path bookkeeping cost more than the coherence saves on scenes that fit in
+// cache, but the sorted per-depth queues are what packet or SIMD traversal would be built on
+struct Wavefront_Path{
+    Ray ray;
+    Hit hit;
+    Color color;
+    double diffuse_light_intensity = 0;
+    double specular_light_intensity = 0;
+    int parent;
+    bool is_refracted;
+    Color reflected_color = Color(0, 0, 0);
+    Color refracted_color = Color(0, 0, 0);
+
+    Wavefront_Path(Ray ray, int parent=-1, bool is_refracted=false) : ray(ray), parent(parent), is_refracted(is_refracted) {}
+};
+
+const int wavefront_batch_size = 1 << 16;
+
+void parallel_for(int count, int thread_count, function<void(int, int)> body){
+    int increment = max(1, (count + thread_count - 1) / max(1, thread_count));
+
+    vector<thread> threads;
+
+    for (int i = 0; i < count; i += increment){
+        threads.push_back(thread(body, i, min(count, i + increment)));
+    }
+
+    for (thread& thread : threads) {
+        thread.join();
+    }
+}
+
+uint32_t spread_bits(uint32_t x){
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// direction octant on top, then a 30 bit morton code of the origin inside the scene bounds
+uint64_t ray_sort_key(Ray& ray, vector3 scene_min, vector3 scene_extent){
+    uint64_t octant = (ray.direction.x < 0) | (ray.direction.y < 0) << 1 | (ray.direction.z < 0) << 2;
+    vector3 cell = (ray.origin - scene_min) / scene_extent * 1023;
+    uint32_t x = min(1023.0, max(0.0, cell.x));
+    uint32_t y = min(1023.0, max(0.0, cell.y));
+    uint32_t z = min(1023.0, max(0.0, cell.z));
+
+    return octant << 30 | spread_bits(x) | spread_bits(y) << 1 | spread_bits(z) << 2;
+}
+
+struct Shadow_Ray{
+    Ray ray;
+    vector3 light_direction;
+    int path;
+};
+
+// the box around every object's root node, what the sort keys quantise ray origins against
+void scene_bounds(vector3& scene_min, vector3& scene_extent){
+    scene_min = vector3(INFINITY, INFINITY, INFINITY);
+    vector3 scene_max(-INFINITY, -INFINITY, -INFINITY);
+
+    for (Object& object : scene){
+        BVH bvh = object.bvh();
+
+        if (bvh.node_count == 0) continue;
+
+        scene_min = min_vector3(scene_min, bvh.nodes[0].bounds_min);
+        scene_max = max_vector3(scene_max, bvh.nodes[0].bounds_max);
+    }
+
+    if (scene_max.x < scene_min.x) scene_min = scene_max = vector3(0, 0, 0);
+
+    scene_extent = max_vector3(scene_max - scene_min, vector3(1e-6, 1e-6, 1e-6));
+}
+
+// queues are physically reordered rather than walked through an index, so the batched intersection reads them front
+// to back. anything with a ray member can be sorted
+template <typename T>
+void sort_rays(vector<T>& queue, vector3 scene_min, vector3 scene_extent, int thread_count){
+    vector<pair<uint64_t, int>> keys(queue.size());
+
+    parallel_for(queue.size(), thread_count, [&](int start, int end){
+        for (int i = start; i < end; ++i){
+            keys[i] = {ray_sort_key(queue[i].ray, scene_min, scene_extent), i};
+        }
+    });
+
+    sort(keys.begin(), keys.end());
+
+    vector<T> sorted;
+    sorted.reserve(queue.size());
+
+    for (auto& key : keys) sorted.push_back(move(queue[key.second]));
+
+    queue.swap(sorted);
+}
+
+void wavefront_batch(int first_ray, int last_ray, int width, int height, int thread_count, Uint32* pixels, Denoise_Buffers* buffers){
+    vector3 scene_min, scene_extent;
+    scene_bounds(scene_min, scene_extent);
+
+    vector<vector<Wavefront_Path>> depths(1);
+    depths[0].reserve(last_ray - first_ray);
+
+    for (int i = first_ray; i < last_ray; ++i){
+        depths[0].push_back(Wavefront_Path(camera.rays[i]));
+    }
+
+    for (int depth = 0; !depths[depth].empty(); ++depth){
+        vector<Wavefront_Path>& paths = depths[depth];
+
+        // primary rays come out of the camera already coherent. later depths are sorted before anything refers to them
+        // by index, their parent indices point into the depth above so they stay valid
+        if (depth > 0) sort_rays(paths, scene_min, scene_extent, thread_count);
+
+        parallel_for(paths.size(), thread_count, [&](int start, int end){
+            for (int i = start; i < end; ++i){
+                Wavefront_Path& path = paths[i];
+
+                if (path.ray.reflection > camera.max_reflections) continue;
+
+                path.hit = is_intersecting(path.ray);
+
+                if (path.hit.result.x == INFINITY) continue;
+
+                path.ray.distance += path.hit.result.x;
+                interpolate_attributes(path.hit);
+                path.color = material_color(path.hit.object->material, path.hit, path.ray);
+            }
+        });
+
+        // one light at a time so each path sums its lights in the same order simple_cast does
+        for (Light& light : lights){
+            vector<Shadow_Ray> shadow_rays;
+            shadow_rays.reserve(paths.size());
+
+            for (int i = 0; i < (int)paths.size(); ++i){
+                Hit& hit = paths[i].hit;
+
+                if (hit.object == nullptr || hit.object->material.flag != is_lit) continue;
+
+                vector3 light_direction = (light.position - hit.position).normalize();
+                shadow_rays.push_back(Shadow_Ray{shadow_ray(hit, light_direction), light_direction, i});
+            }
+
+            sort_rays(shadow_rays, scene_min, scene_extent, thread_count);
+
+            vector<char> is_lit_by(paths.size(), 0);
+
+            parallel_for(shadow_rays.size(), thread_count, [&](int start, int end){
+                for (int i = start; i < end; ++i){
+                    Hit shadow_hit = is_intersecting(shadow_rays[i].ray);
+                    is_lit_by[shadow_rays[i].path] = is_reaching_light(shadow_hit);
+                }
+            });
+
+            for (Shadow_Ray& shadow : shadow_rays){
+                if (!is_lit_by[shadow.path]) continue;
+
+                Wavefront_Path& path = paths[shadow.path];
+                add_light(light, path.ray, path.hit, shadow.light_direction, path.diffuse_light_intensity, path.specular_light_intensity);
+            }
+        }
+
+        vector<Wavefront_Path> next;
+        next.reserve(paths.size());
+
+        for (int i = 0; i < (int)paths.size(); ++i){
+            Hit& hit = paths[i].hit;
+
+            if (hit.object == nullptr || hit.object->material.flag != is_lit) continue;
+
+            if (hit.object->material.reflective_albedo > 0) next.push_back(Wavefront_Path(reflected_ray(paths[i].ray, hit), i, false));
+            if (hit.object->material.refractive_albedo > 0) next.push_back(Wavefront_Path(refracted_ray(paths[i].ray, hit), i, true));
+        }
+
+        depths.push_back(move(next));
+    }
+
+    // children finish before their parents, so walk the depths backwards and hand each colour up the tree
+    for (int depth = depths.size() - 1; depth >= 0; --depth){
+        for (Wavefront_Path& path : depths[depth]){
+            Hit& hit = path.hit;
+            Color color = Color(0, 0, 20);
+
+            if (hit.object != nullptr){
+                color = hit.object->material.flag == is_lit
+                    ? lit_color(hit.object->material, path.color, path.diffuse_light_intensity, path.specular_light_intensity, path.reflected_color, path.refracted_color)
+                    : unlit_color(hit, path.color);
+            }
+
+            if (path.parent >= 0){
+                Wavefront_Path& parent = depths[depth - 1][path.parent];
+                (path.is_refracted ? parent.refracted_color : parent.reflected_color) = color;
+                continue;
+            }
+
+            Surface surface;
+            if (hit.object != nullptr) surface = Surface{hit.normal, path.ray.distance, int(hit.object - scene.data()), path.color};
+
+            write_ray(path.ray, color.to_hex(), surface, width, height, pixels, buffers);
+        }
+    }
+}
+
+// primary rays go through in batches so the per-ray state stays a few megabytes at any resolution
+void wavefront_render(int width, int height, int thread_count, Uint32* pixels, Denoise_Buffers* buffers){
+    for (int i = 0; i < (int)camera.rays.size(); i += wavefront_batch_size){
+        wavefront_batch(i, min((int)camera.rays.size(), i + wavefront_batch_size), width, height, thread_count, pixels, buffers);
+    }
+}
+
+bool is_same_vector3(vector3 a, vector3 b){
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// whether the object only turned about its spin axis since it was recorded, which leaves its motion boxes as they were.
+// objects spinning about more than one axis have boxes around their bounding sphere, so any rotation keeps those
+bool is_spin_only(Object_State& previous, Object& object){
+    if (!is_same_vector3(previous.position, object.position) || !is_same_vector3(previous.scale, object.scale) || !is_same_vector3(previous.spin, object.spin)){
+        return false;
+    }
+
+    int spin_axes = (object.spin.x != 0) + (object.spin.y != 0) + (object.spin.z != 0);
+
+    if (spin_axes == 0) return false;
+    if (spin_axes > 1) return true;
+
+    return (object.spin.x != 0 || previous.rotation.x == object.rotation.x) &&
+        (object.spin.y != 0 || previous.rotation.y == object.rotation.y) &&
+        (object.spin.z != 0 || previous.rotation.z == object.rotation.z);
+}
+
+// works out which camera rays have to be traced again. everything is re-traced when the camera, a light, the frame
+// size or the set of objects changed, or when an object did more than turn about its spin axis, since a ray that never
+// came near its old boxes could hit it now. boxes are only built for spinning objects and kept for as long as that's
+// all they do
+vector<int> dirty_rays(int width, int height, Denoise_Buffers* buffers){
+    Incremental_State& state = incremental_state;
+    vector<int> dirty;
+
+    bool full = !state.valid || state.width != width || state.height != height || state.has_buffers != (buffers != nullptr) ||
+        state.touched.size() != camera.rays.size() || state.objects.size() != scene.size() || state.lights.size() != lights.size() ||
+        state.camera_resolution != camera.resolution || state.camera_fov != camera.fov || state.camera_max_reflections != camera.max_reflections;
+
+    full = full || !is_same_vector3(state.camera_position, camera.position) || !is_same_vector3(state.camera_rotation, camera.rotation);
+
+    for (int i = 0; !full && i < (int)lights.size(); ++i){
+        full = !is_same_vector3(state.lights[i].position, lights[i].position) || state.lights[i].intensity != lights[i].intensity;
+    }
+
+    bool same_objects = state.valid && state.objects.size() == scene.size();
+    uint64_t moved = 0;
+    vector<Object_State> objects;
+
+    for (int i = 0; i < (int)scene.size(); ++i){
+        Object& object = scene[i];
+        Object_State current{object.position, object.rotation, object.scale, object.spin, {}};
+        Object_State* previous = same_objects ? &state.objects[i] : nullptr;
+
+        bool unchanged = previous != nullptr && is_same_vector3(previous->rotation, object.rotation) && is_same_vector3(previous->position, object.position) &&
+            is_same_vector3(previous->scale, object.scale) && is_same_vector3(previous->spin, object.spin);
+        bool spun = previous != nullptr && !unchanged && is_spin_only(*previous, object);
+
+        if (unchanged || spun){
+            current.motion_boxes = previous->motion_boxes;
+        } else {
+            full = true;
+
+            if (object.spin.x != 0 || object.spin.y != 0 || object.spin.z != 0) current.motion_boxes = object.motion_boxes();
+        }
+
+        if (spun) moved |= object_bit(i);
+
+        objects.push_back(current);
+    }
+
+    motion_boxes.clear();
+    motion_box_bits.clear();
+
+    for (int i = 0; i < (int)objects.size(); ++i){
+        for (BVH_Node& box : objects[i].motion_boxes){
+            motion_boxes.push_back(box);
+            motion_box_bits.push_back(object_bit(i));
+        }
+    }
+
+    if (full){
+        state.touched.assign(camera.rays.size(), 0);
+        state.colors.assign(camera.rays.size(), 0);
+    }
+
+    for (int i = 0; i < (int)camera.rays.size(); ++i){
+        if (full || (state.touched[i] & moved) != 0) dirty.push_back(i);
+    }
+
+    state.valid = true;
+    state.has_buffers = buffers != nullptr;
+    state.width = width;
+    state.height = height;
+    state.camera_position = camera.position;
+    state.camera_rotation = camera.rotation;
+    state.camera_resolution = camera.resolution;
+    state.camera_fov = camera.fov;
+    state.camera_max_reflections = camera.max_reflections;
+    state.objects.swap(objects);
+    state.lights.clear();
+
+    for (Light& light : lights){
+        state.lights.push_back(Light_State{light.position, light.intensity});
+    }
+
+    return dirty;
+}
+
+// colours are kept per camera ray and every block is written back each frame, so the denoiser never filters its own
+// output twice. the guide buffers only change where rays were re-traced
+void incremental_render(int width, int height, int thread_count, Uint32* pixels, Denoise_Buffers* buffers){
+    vector<int> dirty = dirty_rays(width, height, buffers);
+    Incremental_State& state = incremental_state;
+
+    parallel_for(dirty.size(), thread_count, [&](int start, int end){
+        for (int i = start; i < end; ++i){
+            Ray& ray = camera.rays[dirty[i]];
+            Surface surface;
+            uint64_t touched = 0;
+
+            state.colors[dirty[i]] = simple_cast(ray, buffers != nullptr ? &surface : nullptr, &touched).to_hex();
+            state.touched[dirty[i]] = touched;
+
+            if (buffers != nullptr) buffers->set(ray_grid_index(ray, *buffers), surface.normal, surface.depth, surface.object, surface.albedo);
+        }
+    });
+
+    parallel_for(camera.rays.size(), thread_count, [&](int start, int end){
+        for (int i = start; i < end; ++i){
+            if (buffers != nullptr){
+                buffers->set_color(ray_grid_index(camera.rays[i], *buffers), state.colors[i]);
+            } else {
+                write_pixel_block(camera.rays[i], state.colors[i], width, height, pixels);
+            }
+        }
+    });
+}
+
+// buffers is only needed when the frame should be denoised afterwards
+void trace_frame(Render_Settings& settings, Uint32* pixels, Denoise_Buffers* buffers){
+    int width = settings.width;
+    int height = settings.height;
+    int thread_count = settings.thread_count;
+
+    camera.generate_rays(width / 2, height / 2);
+
+    if (settings.wavefront){
+        wavefront_render(width, height, thread_count, pixels, buffers);
+        return;
+    }
+
+    if (settings.incremental){
+        incremental_render(width, height, thread_count, pixels, buffers);
+        return;
+    }
+
+    parallel_for(camera.rays.size(), thread_count, [&](int start, int end){
+        simple_cast_thread(start, end, width, height, pixels, buffers);
+    });
+}
+
+void render_frame(Render_Settings& settings, Uint32* pixels, Denoise_Buffers& buffers, bool denoising=true){
+    // at full resolution there's nothing for the filter to clean up yet, the image would only get softer
+    if (!denoising || settings.denoise_iterations == 0 || camera.resolution <= 1){
+        trace_frame(settings, pixels, nullptr);
+        return;
+    }
+
+    int grid_width = ray_grid_size(settings.width);
+    int grid_height = ray_grid_size(settings.height);
+
+    if (buffers.width != grid_width || buffers.height != grid_height){
+        buffers.resize(grid_width, grid_height);
+    }
+
+    trace_frame(settings, pixels, &buffers);
+    denoise(buffers, settings.denoise_iterations, settings.thread_count);
+
+    parallel_for(camera.rays.size(), settings.thread_count, [&](int start, int end){
+        for (int i = start; i < end; ++i){
+            Ray& ray = camera.rays[i];
+            write_pixel_block(ray, buffers.colors[ray_grid_index(ray, buffers)], settings.width, settings.height, pixels);
+        }
+    });
+}
+
+void animate_scene(){
+    for (Object& object : scene){
+        if (object.spin.x != 0 || object.spin.y != 0 || object.spin.z != 0){
+            object.rotation = object.rotation + object.spin;
+            object.update();
+        }
+    }
+}
+
+bool write_ppm(string file_name, Uint32* pixels, int width, int height){
+    ofstream image_file(file_name, ios::binary);
+
+    if (!image_file.is_open()){
+        cerr << "could not write " << file_name << endl;
+        return false;
+    }
+
+    image_file << "P6\n" << width << " " << height << "\n255\n";
+
+    for (int i = 0; i < width * height; ++i){
+        char rgb[3] = {char(pixels[i] >> 24), char(pixels[i] >> 16), char(pixels[i] >> 8)};
+        image_file.write(rgb, 3);
+    }
+
+    return true;
+}
+
+void run_window(Render_Settings& settings){
+    init();
+
+    TTF_Init();
+
+    TTF_Font* font = TTF_OpenFont("GaMaamli-Regular.ttf", 24);
+
+    char angle_text[32];
+    int width = settings.width;
+    int height = settings.height;
 
     int lastTick = now();
     double dt = 0;
@@ -461,8 +2158,10 @@ int main() {
 
     memset(pixels, 255, width * height * sizeof(Uint32));
 
+    Denoise_Buffers buffers;
+    bool denoising = true;
+
     double angle = 0;
-    int thread_count = 20;
 
     bool running = true;
     SDL_Event event;
@@ -486,6 +2185,18 @@ int main() {
                         if(camera.resolution > 1)--camera.resolution;
                         break;
                     }
+                    case SDLK_n:{
+                        denoising = !denoising;
+                        break;
+                    }
+                    case SDLK_m:{
+                        settings.wavefront = !settings.wavefront;
+                        break;
+                    }
+                    case SDLK_b:{
+                        settings.incremental = !settings.incremental;
+                        break;
+                    }
                 }
                 break;
 
@@ -519,25 +2230,12 @@ int main() {
 
         angle += 0.2;
 
-        scene[0].rotation.y += 0.1;
-        scene[0].update();
+        animate_scene();
 
         // lights[0].position = vector3(cos(angle) * 300, 0, sin(angle) * 300);
         // lights[0].update();
 
-        camera.generate_rays(width_half, height_half);
-
-        int increment = width / thread_count;
-
-        vector<thread> threads;
-
-        for (int i = 0; i < width; i+=increment){
-            threads.push_back(thread(simple_cast_thread, i, i + increment, width, height, ref(pixels)));
-        }
-
-        for (thread& thread : threads) {
-            thread.join();
-        }
+        render_frame(settings, pixels, buffers, denoising);
 
         void* mPixels;
         int pitch;
@@ -554,11 +2252,66 @@ int main() {
         snprintf(angle_text, sizeof(angle_text), "%.0f", camera.resolution);
         render_text(renderer, font, angle_text, 0, 26, {255, 255, 255});
         render_text(renderer, font, (width % int(camera.resolution) == 0) ? "(factor)" : "(non-factor)", 0, 52, {160, 160, 160});
+        render_text(renderer, font, denoising && settings.denoise_iterations > 0 ? "denoise on (n)" : "denoise off (n)", 0, 78, {160, 160, 160});
+        render_text(renderer, font, settings.wavefront ? "wavefront (m)" : "depth first (m)", 0, 104, {160, 160, 160});
+        render_text(renderer, font, settings.incremental && !settings.wavefront ? "incremental on (b)" : "incremental off (b)", 0, 130, {160, 160, 160});
 
         SDL_RenderPresent(renderer);
     }
 
+    delete[] pixels;
+
     close(window);
+}
+
+// usage: ./built.cppb [scene or snapshot files...]
+//        ./built.cppb --bake in.scene out.bake
+// scenes with an output statement are rendered straight to disk, so a list of them renders as a batch
+int main(int argc, char* argv[]) {
+    if (argc == 4 && string(argv[1]) == "--bake"){
+        Render_Settings settings;
+
+        if (!read_scene_file(argv[2], settings) || !write_snapshot_file(argv[3], settings)) return 1;
+
+        return 0;
+    }
+
+    vector<string> scene_files;
+
+    for (int i = 1; i < argc; ++i){
+        scene_files.push_back(argv[i]);
+    }
+
+    if (scene_files.empty()){
+        scene_files.push_back("default.scene");
+    }
+
+    for (string& scene_file : scene_files){
+        Render_Settings settings;
+
+        bool loaded = is_snapshot_file(scene_file) ? read_snapshot_file(scene_file, settings) : read_scene_file(scene_file, settings);
+
+        if (!loaded) return 1;
+
+        if (settings.output.empty()){
+            run_window(settings);
+            continue;
+        }
+
+        Uint32* pixels = new Uint32[settings.width * settings.height];
+        memset(pixels, 0, settings.width * settings.height * sizeof(Uint32));
+
+        Denoise_Buffers buffers;
+
+        auto start = chrono::steady_clock::now();
+        render_frame(settings, pixels, buffers);
+        cout << scene_file << " -> " << settings.output << " in " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+
+        bool written = write_ppm(settings.output, pixels, settings.width, settings.height);
+        delete[] pixels;
+
+        if (!written) return 1;
+    }
 
     return 0;
 }